@@ -3,147 +3,236 @@
 
 #include <math.h>
 
+// SSE is baseline on every x86-64 target, other platforms (e.g. Apple arm64) use the scalar path
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define GE_MATH_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define GE_MATH_SSE 0
+#endif
+
+// Kept at 12 bytes: triangles store three of these back to back
 struct vec3 {
 	float x, y, z;
 };
 
-struct Matrix4 {
-	float m[4][4] = { 0 };
+struct alignas(16) vec4 {
+	float x, y, z, w;
 };
 
-vec3 Vector3_Add(vec3 &v1, vec3 &v2) {
+// Row-vector convention: v' = v * M, translation lives in m[3]
+struct alignas(16) Matrix4 {
+	float m[4][4];
+
+	constexpr Matrix4()
+		: m{ { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } } {
+	}
+
+	constexpr Matrix4(float m00, float m01, float m02, float m03,
+					  float m10, float m11, float m12, float m13,
+					  float m20, float m21, float m22, float m23,
+					  float m30, float m31, float m32, float m33)
+		: m{ { m00, m01, m02, m03 }, { m10, m11, m12, m13 }, { m20, m21, m22, m23 }, { m30, m31, m32, m33 } } {
+	}
+};
+
+constexpr vec3 Vector3_Add(const vec3 &v1, const vec3 &v2) {
 	return { v1.x + v2.x, v1.y + v2.y, v1.z + v2.z };
 }
 
-vec3 Vector3_Sub(vec3 &v1, vec3 &v2) {
+constexpr vec3 Vector3_Sub(const vec3 &v1, const vec3 &v2) {
 	return { v1.x - v2.x, v1.y - v2.y, v1.z - v2.z };
 }
 
-vec3 Vector3_Mul(vec3 &v1, float k) {
+constexpr vec3 Vector3_Mul(const vec3 &v1, float k) {
 	return { v1.x * k, v1.y * k, v1.z * k };
 }
 
-vec3 Vector3_Div(vec3 &v1, float k) {
+constexpr vec3 Vector3_Div(const vec3 &v1, float k) {
 	return { v1.x / k, v1.y / k, v1.z / k };
 }
 
-float Vector3_DotProduct(vec3 &v1, vec3 &v2) {
+constexpr float Vector3_DotProduct(const vec3 &v1, const vec3 &v2) {
 	return (v1.x * v2.x + v1.y * v2.y + v1.z * v2.z);
 }
 
-float Vector3_Length(vec3 &v)
+inline float Vector3_Length(const vec3 &v)
 {
 	return sqrtf(Vector3_DotProduct(v, v));
 }
 
-bool Vector3_Equals(vec3 &v1, vec3 &v2) {
-	if (v1.x == v2.x && v1.y == v2.y && v1.z == v2.z){
-		return true;
-	}
-	return false;
+constexpr bool Vector3_Equals(const vec3 &v1, const vec3 &v2) {
+	return v1.x == v2.x && v1.y == v2.y && v1.z == v2.z;
 }
 
-vec3 Vector3_Normalize(vec3 &v) {
+inline vec3 Vector3_Normalize(const vec3 &v) {
 	float l = Vector3_Length(v);
 	return { v.x / l, v.y / l, v.z / l };
 }
 
-vec3 Vector3_CrossProduct(vec3 &v1, vec3 &v2)
+constexpr vec3 Vector3_CrossProduct(const vec3 &v1, const vec3 &v2)
+{
+	return {
+		v1.y * v2.z - v1.z * v2.y,
+		v1.z * v2.x - v1.x * v2.z,
+		v1.x * v2.y - v1.y * v2.x
+	};
+}
+
+// t receives the intersection parameter along lineStart -> lineEnd
+inline vec3 Vector3_IntersectPlane(const vec3 &plane_p, const vec3 &plane_n, const vec3 &lineStart, const vec3 &lineEnd, float &t)
 {
-	vec3 v;
-	v.x = v1.y * v2.z - v1.z * v2.y;
-	v.y = v1.z * v2.x - v1.x * v2.z;
-	v.z = v1.x * v2.y - v1.y * v2.x;
-	return v;
+	vec3 n = Vector3_Normalize(plane_n);
+	float plane_d = -Vector3_DotProduct(n, plane_p);
+	float ad = Vector3_DotProduct(lineStart, n);
+	float bd = Vector3_DotProduct(lineEnd, n);
+	t = (-plane_d - ad) / (bd - ad);
+	return Vector3_Add(lineStart, Vector3_Mul(Vector3_Sub(lineEnd, lineStart), t));
 }
 
-vec3 Vector3_IntersectPlane(vec3 &plane_p, vec3 &plane_n, vec3 &lineStart, vec3 &lineEnd)
+inline vec3 Vector3_IntersectPlane(const vec3 &plane_p, const vec3 &plane_n, const vec3 &lineStart, const vec3 &lineEnd)
 {
-	plane_n = Vector3_Normalize(plane_n);
-	float plane_d = -Vector3_DotProduct(plane_n, plane_p);
-	float ad = Vector3_DotProduct(lineStart, plane_n);
-	float bd = Vector3_DotProduct(lineEnd, plane_n);
-	float t = (-plane_d - ad) / (bd - ad);
-	vec3 lineStartToEnd = Vector3_Sub(lineEnd, lineStart);
-	vec3 lineToIntersect = Vector3_Mul(lineStartToEnd, t);
-	return Vector3_Add(lineStart, lineToIntersect);
-}
-
-vec3 Matrix4_MultiplyVector(vec3 &i, Matrix4 &m) {
-	vec3 o;
-	o.x = i.x * m.m[0][0] + i.y * m.m[1][0] + i.z * m.m[2][0] + m.m[3][0];
-	o.y = i.x * m.m[0][1] + i.y * m.m[1][1] + i.z * m.m[2][1] + m.m[3][1];
-	o.z = i.x * m.m[0][2] + i.y * m.m[1][2] + i.z * m.m[2][2] + m.m[3][2];
-
-	float w = i.x * m.m[0][3] + i.y * m.m[1][3] + i.z * m.m[2][3] + m.m[3][3];
-	if (w != 0.0f)
+	float t;
+	return Vector3_IntersectPlane(plane_p, plane_n, lineStart, lineEnd, t);
+}
+
+// Full 4D product, no perspective divide
+inline vec4 Matrix4_MultiplyVector4(const vec4 &i, const Matrix4 &m) {
+	vec4 o;
+#if GE_MATH_SSE
+	__m128 r = _mm_mul_ps(_mm_set1_ps(i.x), _mm_load_ps(m.m[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(i.y), _mm_load_ps(m.m[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(i.z), _mm_load_ps(m.m[2])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(i.w), _mm_load_ps(m.m[3])));
+	_mm_store_ps(&o.x, r);
+#else
+	o.x = i.x * m.m[0][0] + i.y * m.m[1][0] + i.z * m.m[2][0] + i.w * m.m[3][0];
+	o.y = i.x * m.m[0][1] + i.y * m.m[1][1] + i.z * m.m[2][1] + i.w * m.m[3][1];
+	o.z = i.x * m.m[0][2] + i.y * m.m[1][2] + i.z * m.m[2][2] + i.w * m.m[3][2];
+	o.w = i.x * m.m[0][3] + i.y * m.m[1][3] + i.z * m.m[2][3] + i.w * m.m[3][3];
+#endif
+	return o;
+}
+
+// Point transform for matrices whose last column is (0, 0, 0, 1): world, view, rotations, translations
+inline vec3 Matrix4_MultiplyVectorAffine(const vec3 &i, const Matrix4 &m) {
+#if GE_MATH_SSE
+	__m128 r = _mm_mul_ps(_mm_set1_ps(i.x), _mm_load_ps(m.m[0]));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(i.y), _mm_load_ps(m.m[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(i.z), _mm_load_ps(m.m[2])));
+	r = _mm_add_ps(r, _mm_load_ps(m.m[3]));
+	alignas(16) float o[4];
+	_mm_store_ps(o, r);
+	return { o[0], o[1], o[2] };
+#else
+	return {
+		i.x * m.m[0][0] + i.y * m.m[1][0] + i.z * m.m[2][0] + m.m[3][0],
+		i.x * m.m[0][1] + i.y * m.m[1][1] + i.z * m.m[2][1] + m.m[3][1],
+		i.x * m.m[0][2] + i.y * m.m[1][2] + i.z * m.m[2][2] + m.m[3][2]
+	};
+#endif
+}
+
+// General point transform with perspective divide (projection)
+inline vec3 Matrix4_MultiplyVector(const vec3 &i, const Matrix4 &m) {
+	vec4 o = Matrix4_MultiplyVector4({ i.x, i.y, i.z, 1.0f }, m);
+	if (o.w != 0.0f)
 	{
-		o.x /= w;
-		o.y /= w;
-		o.z /= w;
+#if GE_MATH_SSE
+		alignas(16) float d[4];
+		_mm_store_ps(d, _mm_div_ps(_mm_load_ps(&o.x), _mm_set1_ps(o.w)));
+		return { d[0], d[1], d[2] };
+#else
+		return { o.x / o.w, o.y / o.w, o.z / o.w };
+#endif
 	}
-	return o;
+	return { o.x, o.y, o.z };
 }
 
-Matrix4 Matrix4_MakeIdentity() {
-	Matrix4 matrix;
-	matrix.m[0][0] = 1.0f;
-	matrix.m[1][1] = 1.0f;
-	matrix.m[2][2] = 1.0f;
-	matrix.m[3][3] = 1.0f;
-	return matrix;
+constexpr Matrix4 Matrix4_MakeIdentity() {
+	return Matrix4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
 }
 
-Matrix4 Matrix4_MakeRotationX(float fAngleRad)
+inline Matrix4 Matrix4_MakeRotationX(float fAngleRad)
 {
-	Matrix4 matrix;
-	matrix.m[0][0] = 1.0f;
-	matrix.m[1][1] = cosf(fAngleRad);
-	matrix.m[1][2] = sinf(fAngleRad);
-	matrix.m[2][1] = -sinf(fAngleRad);
-	matrix.m[2][2] = cosf(fAngleRad);
-	matrix.m[3][3] = 1.0f;
-	return matrix;
+	float c = cosf(fAngleRad), s = sinf(fAngleRad);
+	return Matrix4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, c, s, 0.0f,
+		0.0f, -s, c, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
 }
 
-Matrix4 Matrix4_MakeRotationY(float fAngleRad)
+inline Matrix4 Matrix4_MakeRotationY(float fAngleRad)
 {
-	Matrix4 matrix;
-	matrix.m[0][0] = cosf(fAngleRad);
-	matrix.m[0][2] = sinf(fAngleRad);
-	matrix.m[2][0] = -sinf(fAngleRad);
-	matrix.m[1][1] = 1.0f;
-	matrix.m[2][2] = cosf(fAngleRad);
-	matrix.m[3][3] = 1.0f;
-	return matrix;
+	float c = cosf(fAngleRad), s = sinf(fAngleRad);
+	return Matrix4(
+		c, 0.0f, s, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		-s, 0.0f, c, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
 }
 
-Matrix4 Matrix4_MakeRotationZ(float fAngleRad)
+inline Matrix4 Matrix4_MakeRotationZ(float fAngleRad)
 {
-	Matrix4 matrix;
-	matrix.m[0][0] = cosf(fAngleRad);
-	matrix.m[0][1] = sinf(fAngleRad);
-	matrix.m[1][0] = -sinf(fAngleRad);
-	matrix.m[1][1] = cosf(fAngleRad);
-	matrix.m[2][2] = 1.0f;
-	matrix.m[3][3] = 1.0f;
-	return matrix;
+	float c = cosf(fAngleRad), s = sinf(fAngleRad);
+	return Matrix4(
+		c, s, 0.0f, 0.0f,
+		-s, c, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// Exact cos/sin of quarterTurns * 90 degrees, so quarter-turn rotations carry no cosf/sinf rounding
+constexpr float GE_QuarterTurnCos(int quarterTurns) {
+	return (quarterTurns & 3) == 0 ? 1.0f : (quarterTurns & 3) == 2 ? -1.0f : 0.0f;
 }
 
-Matrix4 Matrix4_MakeTranslation(float x, float y, float z)
+constexpr float GE_QuarterTurnSin(int quarterTurns) {
+	return (quarterTurns & 3) == 1 ? 1.0f : (quarterTurns & 3) == 3 ? -1.0f : 0.0f;
+}
+
+constexpr Matrix4 Matrix4_MakeQuarterRotationX(int quarterTurns)
 {
-	Matrix4 matrix;
-	matrix.m[0][0] = 1.0f;
-	matrix.m[1][1] = 1.0f;
-	matrix.m[2][2] = 1.0f;
-	matrix.m[3][3] = 1.0f;
-	matrix.m[3][0] = x;
-	matrix.m[3][1] = y;
-	matrix.m[3][2] = z;
-	return matrix;
+	return Matrix4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, GE_QuarterTurnCos(quarterTurns), GE_QuarterTurnSin(quarterTurns), 0.0f,
+		0.0f, -GE_QuarterTurnSin(quarterTurns), GE_QuarterTurnCos(quarterTurns), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
 }
 
-Matrix4 Matrix4_MakeProjection(float fFovDegrees, float fAspectRatio, float fNear, float fFar)
+constexpr Matrix4 Matrix4_MakeQuarterRotationY(int quarterTurns)
+{
+	return Matrix4(
+		GE_QuarterTurnCos(quarterTurns), 0.0f, GE_QuarterTurnSin(quarterTurns), 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		-GE_QuarterTurnSin(quarterTurns), 0.0f, GE_QuarterTurnCos(quarterTurns), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+constexpr Matrix4 Matrix4_MakeQuarterRotationZ(int quarterTurns)
+{
+	return Matrix4(
+		GE_QuarterTurnCos(quarterTurns), GE_QuarterTurnSin(quarterTurns), 0.0f, 0.0f,
+		-GE_QuarterTurnSin(quarterTurns), GE_QuarterTurnCos(quarterTurns), 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+constexpr Matrix4 Matrix4_MakeTranslation(float x, float y, float z)
+{
+	return Matrix4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		x, y, z, 1.0f);
+}
+
+inline Matrix4 Matrix4_MakeProjection(float fFovDegrees, float fAspectRatio, float fNear, float fFar)
 {
 	float fFovRad = 1.0f / tanf(fFovDegrees * 0.5f / 180.0f * 3.14159f);
 	Matrix4 matrix;
@@ -156,52 +245,51 @@ Matrix4 Matrix4_MakeProjection(float fFovDegrees, float fAspectRatio, float fNea
 	return matrix;
 }
 
-Matrix4 Matrix4_MultiplyMatrix(Matrix4 &m1, Matrix4 &m2)
+inline Matrix4 Matrix4_MultiplyMatrix(const Matrix4 &m1, const Matrix4 &m2)
 {
 	Matrix4 matrix;
-	for (int c = 0; c < 4; c++) {
-		for (int r = 0; r < 4; r++) {
-			matrix.m[r][c] = m1.m[r][0] * m2.m[0][c] + m1.m[r][1] * m2.m[1][c] + m1.m[r][2] * m2.m[2][c] + m1.m[r][3] * m2.m[3][c];
-		}
+	for (int r = 0; r < 4; r++) {
+		// Row r of the product is row r of m1 applied to m2
+		vec4 row = Matrix4_MultiplyVector4({ m1.m[r][0], m1.m[r][1], m1.m[r][2], m1.m[r][3] }, m2);
+		matrix.m[r][0] = row.x;
+		matrix.m[r][1] = row.y;
+		matrix.m[r][2] = row.z;
+		matrix.m[r][3] = row.w;
 	}
 	return matrix;
 }
 
-Matrix4 Matrix4_PointAt(vec3 &pos, vec3 &target, vec3 &up)
+inline Matrix4 Matrix4_PointAt(const vec3 &pos, const vec3 &target, const vec3 &up)
 {
 	// Calculate new forward direction
-	vec3 newForward = Vector3_Sub(target, pos);
-	newForward = Vector3_Normalize(newForward);
+	vec3 newForward = Vector3_Normalize(Vector3_Sub(target, pos));
 
 	// Calculate new Up direction
 	vec3 a = Vector3_Mul(newForward, Vector3_DotProduct(up, newForward));
-	vec3 newUp = Vector3_Sub(up, a);
-	newUp = Vector3_Normalize(newUp);
+	vec3 newUp = Vector3_Normalize(Vector3_Sub(up, a));
 
 	// New Right direction is easy, its just cross product
 	vec3 newRight = Vector3_CrossProduct(newUp, newForward);
 
-	// Construct Dimensioning and Translation Matrix	
-	Matrix4 matrix;
-	matrix.m[0][0] = newRight.x;	matrix.m[0][1] = newRight.y;	matrix.m[0][2] = newRight.z;	matrix.m[0][3] = 0.0f;
-	matrix.m[1][0] = newUp.x;		matrix.m[1][1] = newUp.y;		matrix.m[1][2] = newUp.z;		matrix.m[1][3] = 0.0f;
-	matrix.m[2][0] = newForward.x;	matrix.m[2][1] = newForward.y;	matrix.m[2][2] = newForward.z;	matrix.m[2][3] = 0.0f;
-	matrix.m[3][0] = pos.x;			matrix.m[3][1] = pos.y;			matrix.m[3][2] = pos.z;			matrix.m[3][3] = 1.0f;
-	return matrix;
-
+	// Construct Dimensioning and Translation Matrix
+	return Matrix4(
+		newRight.x,		newRight.y,		newRight.z,		0.0f,
+		newUp.x,		newUp.y,		newUp.z,		0.0f,
+		newForward.x,	newForward.y,	newForward.z,	0.0f,
+		pos.x,			pos.y,			pos.z,			1.0f);
 }
 
-Matrix4 Matrix4_QuickInverse(Matrix4 &m) // Only for Rotation/Translation Matrixes
+inline Matrix4 Matrix4_QuickInverse(const Matrix4 &m) // Only for Rotation/Translation Matrixes
 {
-	Matrix4 matrix;
-	matrix.m[0][0] = m.m[0][0]; matrix.m[0][1] = m.m[1][0]; matrix.m[0][2] = m.m[2][0]; matrix.m[0][3] = 0.0f;
-	matrix.m[1][0] = m.m[0][1]; matrix.m[1][1] = m.m[1][1]; matrix.m[1][2] = m.m[2][1]; matrix.m[1][3] = 0.0f;
-	matrix.m[2][0] = m.m[0][2]; matrix.m[2][1] = m.m[1][2]; matrix.m[2][2] = m.m[2][2]; matrix.m[2][3] = 0.0f;
-	matrix.m[3][0] = -(m.m[3][0] * matrix.m[0][0] + m.m[3][1] * matrix.m[1][0] + m.m[3][2] * matrix.m[2][0]);
-	matrix.m[3][1] = -(m.m[3][0] * matrix.m[0][1] + m.m[3][1] * matrix.m[1][1] + m.m[3][2] * matrix.m[2][1]);
-	matrix.m[3][2] = -(m.m[3][0] * matrix.m[0][2] + m.m[3][1] * matrix.m[1][2] + m.m[3][2] * matrix.m[2][2]);
-	matrix.m[3][3] = 1.0f;
-	return matrix;
+	// Transposed rotation, translation rotated back and negated
+	return Matrix4(
+		m.m[0][0], m.m[1][0], m.m[2][0], 0.0f,
+		m.m[0][1], m.m[1][1], m.m[2][1], 0.0f,
+		m.m[0][2], m.m[1][2], m.m[2][2], 0.0f,
+		-(m.m[3][0] * m.m[0][0] + m.m[3][1] * m.m[0][1] + m.m[3][2] * m.m[0][2]),
+		-(m.m[3][0] * m.m[1][0] + m.m[3][1] * m.m[1][1] + m.m[3][2] * m.m[1][2]),
+		-(m.m[3][0] * m.m[2][0] + m.m[3][1] * m.m[2][1] + m.m[3][2] * m.m[2][2]),
+		1.0f);
 }
 
 #endif
@@ -0,0 +1,250 @@
+#ifndef GE_BVH_H
+#define GE_BVH_H
+
+#include <algorithm>
+#include <vector>
+#include "GE_3DMath.h"
+
+// Bounding volume hierarchy over an indexed triangle mesh.
+// Built once at import by median splits along the longest axis, then used
+// to skip whole subtrees outside the view frustum and to answer ray queries
+// without testing every triangle.
+
+struct GE_BVHNode {
+	vec3 boundsMin;
+	vec3 boundsMax;
+	unsigned int first; // First entry of triangleOrder for leaves, index of the left child otherwise (right child follows it)
+	unsigned int count; // Triangle count of a leaf, 0 for inner nodes
+};
+
+// Planes point inwards, a point p is inside when dot(n, p) + d >= 0 for every plane
+struct GE_Frustum {
+	vec4 planes[5];
+	int planeCount = 0;
+};
+
+enum class GE_CULL_RESULT {
+	OUTSIDE,
+	INTERSECTING,
+	INSIDE
+};
+
+// Left, right, bottom, top and near planes of a model-view-projection matrix (row vectors, clip z from 0 at near)
+inline GE_Frustum GE_Frustum_FromMatrix(const Matrix4 &m) {
+	GE_Frustum f;
+	auto column = [&](int c) { return vec4{ m.m[0][c], m.m[1][c], m.m[2][c], m.m[3][c] }; };
+	vec4 x = column(0), y = column(1), z = column(2), w = column(3);
+	f.planes[0] = { w.x + x.x, w.y + x.y, w.z + x.z, w.w + x.w };
+	f.planes[1] = { w.x - x.x, w.y - x.y, w.z - x.z, w.w - x.w };
+	f.planes[2] = { w.x + y.x, w.y + y.y, w.z + y.z, w.w + y.w };
+	f.planes[3] = { w.x - y.x, w.y - y.y, w.z - y.z, w.w - y.w };
+	f.planes[4] = z;
+	f.planeCount = 5;
+	return f;
+}
+
+inline GE_CULL_RESULT GE_Frustum_ClassifyBox(const GE_Frustum &f, const vec3 &boundsMin, const vec3 &boundsMax) {
+	GE_CULL_RESULT result = GE_CULL_RESULT::INSIDE;
+	for (int i = 0; i < f.planeCount; i++) {
+		const vec4 &p = f.planes[i];
+		// Corner furthest along the plane normal decides outside, the nearest one decides inside
+		float farthest = p.x * (p.x >= 0 ? boundsMax.x : boundsMin.x) + p.y * (p.y >= 0 ? boundsMax.y : boundsMin.y) + p.z * (p.z >= 0 ? boundsMax.z : boundsMin.z) + p.w;
+		if (farthest < 0) {
+			return GE_CULL_RESULT::OUTSIDE;
+		}
+		float nearest = p.x * (p.x >= 0 ? boundsMin.x : boundsMax.x) + p.y * (p.y >= 0 ? boundsMin.y : boundsMax.y) + p.z * (p.z >= 0 ? boundsMin.z : boundsMax.z) + p.w;
+		if (nearest < 0) {
+			result = GE_CULL_RESULT::INTERSECTING;
+		}
+	}
+	return result;
+}
+
+class GE_BVH {
+private:
+	static void grow(vec3 &boundsMin, vec3 &boundsMax, const vec3 &p) {
+		boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+		boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+	}
+
+	static bool intersectBox(const GE_BVHNode &node, const vec3 &origin, const vec3 &inverseDirection, float maxT) {
+		// Slab test
+		float t0 = 0.0f, t1 = maxT;
+		const float *o = &origin.x, *inv = &inverseDirection.x, *lo = &node.boundsMin.x, *hi = &node.boundsMax.x;
+		for (int a = 0; a < 3; a++) {
+			float tNear = (lo[a] - o[a]) * inv[a];
+			float tFar = (hi[a] - o[a]) * inv[a];
+			if (tNear > tFar) {
+				std::swap(tNear, tFar);
+			}
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+			if (t0 > t1) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool intersectTriangle(const vec3 &origin, const vec3 &direction, const vec3 &a, const vec3 &b, const vec3 &c, float &t) {
+		// Moller-Trumbore, both faces count as a hit
+		vec3 e1 = Vector3_Sub(b, a), e2 = Vector3_Sub(c, a);
+		vec3 p = Vector3_CrossProduct(direction, e2);
+		float det = Vector3_DotProduct(e1, p);
+		if (fabsf(det) < 1e-8f) {
+			return false;
+		}
+		float invDet = 1.0f / det;
+		vec3 s = Vector3_Sub(origin, a);
+		float u = Vector3_DotProduct(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		vec3 q = Vector3_CrossProduct(s, e1);
+		float v = Vector3_DotProduct(direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		t = Vector3_DotProduct(e2, q) * invDet;
+		return t > 0.0f;
+	}
+
+public:
+	std::vector<GE_BVHNode> nodes;
+	std::vector<unsigned int> triangleOrder; // Triangle numbers grouped by leaf
+
+	void build(const std::vector<vec3> &vertices, const std::vector<unsigned int> &indices, unsigned int leafSize = 8) {
+		size_t triangleCount = indices.size() / 3;
+		nodes.clear();
+		triangleOrder.resize(triangleCount);
+		std::vector<vec3> centroids(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++) {
+			triangleOrder[t] = (unsigned int)t;
+			vec3 sum = Vector3_Add(Vector3_Add(vertices[indices[3 * t]], vertices[indices[3 * t + 1]]), vertices[indices[3 * t + 2]]);
+			centroids[t] = Vector3_Mul(sum, 1.0f / 3.0f);
+		}
+		if (triangleCount == 0) {
+			return;
+		}
+		nodes.reserve(2 * triangleCount / std::max(1u, leafSize) + 1);
+
+		struct Pending {
+			unsigned int node, first, count;
+		};
+		std::vector<Pending> stack;
+		nodes.push_back(GE_BVHNode());
+		stack.push_back({ 0, 0, (unsigned int)triangleCount });
+		while (!stack.empty()) {
+			Pending p = stack.back();
+			stack.pop_back();
+
+			vec3 boundsMin = vertices[indices[3 * triangleOrder[p.first]]], boundsMax = boundsMin;
+			vec3 centroidMin = centroids[triangleOrder[p.first]], centroidMax = centroidMin;
+			for (unsigned int i = p.first; i < p.first + p.count; i++) {
+				unsigned int t = triangleOrder[i];
+				for (int k = 0; k < 3; k++) {
+					grow(boundsMin, boundsMax, vertices[indices[3 * t + k]]);
+				}
+				grow(centroidMin, centroidMax, centroids[t]);
+			}
+			nodes[p.node].boundsMin = boundsMin;
+			nodes[p.node].boundsMax = boundsMax;
+
+			vec3 extent = Vector3_Sub(centroidMax, centroidMin);
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+			float axisExtent = axis == 0 ? extent.x : axis == 1 ? extent.y : extent.z;
+			if (p.count <= leafSize || axisExtent <= 0.0f) {
+				nodes[p.node].first = p.first;
+				nodes[p.node].count = p.count;
+				continue;
+			}
+
+			unsigned int half = p.count / 2;
+			std::nth_element(triangleOrder.begin() + p.first, triangleOrder.begin() + p.first + half, triangleOrder.begin() + p.first + p.count,
+				[&](unsigned int a, unsigned int b) { return (&centroids[a].x)[axis] < (&centroids[b].x)[axis]; });
+
+			// Children are allocated as a pair
+			unsigned int left = (unsigned int)nodes.size();
+			nodes.push_back(GE_BVHNode());
+			nodes.push_back(GE_BVHNode());
+			nodes[p.node].first = left;
+			nodes[p.node].count = 0;
+			stack.push_back({ left + 1, p.first + half, p.count - half });
+			stack.push_back({ left, p.first, half });
+		}
+	}
+
+	// Calls leaf(first, count) for every leaf not culled by the frustum, subtrees fully inside are not tested further
+	template <typename LeafFunc>
+	void forEachVisibleLeaf(const GE_Frustum &frustum, LeafFunc leaf) const {
+		if (nodes.empty()) {
+			return;
+		}
+		struct Pending {
+			unsigned int node;
+			bool inside;
+		};
+		Pending stack[64];
+		int top = 0;
+		stack[top++] = { 0, false };
+		while (top > 0) {
+			Pending p = stack[--top];
+			const GE_BVHNode &node = nodes[p.node];
+			bool inside = p.inside;
+			if (!inside) {
+				GE_CULL_RESULT result = GE_Frustum_ClassifyBox(frustum, node.boundsMin, node.boundsMax);
+				if (result == GE_CULL_RESULT::OUTSIDE) {
+					continue;
+				}
+				inside = result == GE_CULL_RESULT::INSIDE;
+			}
+			if (node.count > 0) {
+				leaf(node.first, node.count);
+			} else {
+				stack[top++] = { node.first, inside };
+				stack[top++] = { node.first + 1, inside };
+			}
+		}
+	}
+
+	// Nearest hit along the ray, returns false when nothing is hit
+	bool intersectRay(const vec3 &origin, const vec3 &direction, const std::vector<vec3> &vertices, const std::vector<unsigned int> &indices,
+		float &hitT, unsigned int &hitTriangle) const {
+		if (nodes.empty()) {
+			return false;
+		}
+		vec3 inverseDirection = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+		float bestT = 3.4e38f;
+		bool hit = false;
+		unsigned int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			unsigned int index = stack[--top];
+			const GE_BVHNode &node = nodes[index];
+			if (!intersectBox(node, origin, inverseDirection, bestT)) {
+				continue;
+			}
+			if (node.count > 0) {
+				for (unsigned int i = node.first; i < node.first + node.count; i++) {
+					unsigned int t = triangleOrder[i];
+					float triangleT;
+					if (intersectTriangle(origin, direction, vertices[indices[3 * t]], vertices[indices[3 * t + 1]], vertices[indices[3 * t + 2]], triangleT) && triangleT < bestT) {
+						bestT = triangleT;
+						hitTriangle = t;
+						hit = true;
+					}
+				}
+			} else {
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+		}
+		if (hit) {
+			hitT = bestT;
+		}
+		return hit;
+	}
+};
+
+#endif
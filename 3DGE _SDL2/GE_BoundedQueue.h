@@ -0,0 +1,70 @@
+#ifndef GE_BOUNDEDQUEUE_H
+#define GE_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Blocking FIFO with fixed capacity, connects two pipeline stages.
+// Producer waits while the queue is full, so it can never run more than
+// capacity items ahead of the consumer.
+
+template <typename T>
+class GE_BoundedQueue {
+private:
+	std::deque<T> items;
+	size_t capacity;
+	std::mutex lock;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	bool closed = false;
+
+public:
+	explicit GE_BoundedQueue(size_t _capacity = 1) : capacity(_capacity > 0 ? _capacity : 1) {
+	}
+
+	GE_BoundedQueue(const GE_BoundedQueue &) = delete;
+	GE_BoundedQueue &operator=(const GE_BoundedQueue &) = delete;
+
+	// Returns false if the queue was closed, item is dropped then
+	bool push(T item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this]() { return closed || items.size() < capacity; });
+		if (closed) {
+			return false;
+		}
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Returns false once the queue is closed and nothing is left in it
+	bool pop(T &item) {
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this]() { return closed || !items.empty(); });
+		if (items.empty()) {
+			return false;
+		}
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	// Wakes up every waiting thread, queued items can still be popped
+	void close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+	// Drops queued items and opens the queue again, nobody may be waiting on it
+	void reset() {
+		std::lock_guard<std::mutex> guard(lock);
+		items.clear();
+		closed = false;
+	}
+};
+
+#endif
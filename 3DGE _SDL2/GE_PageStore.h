@@ -0,0 +1,102 @@
+#ifndef GE_PAGESTORE_H
+#define GE_PAGESTORE_H
+
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GE_Platform.h"
+
+// Key-value store of byte records in one local file.
+// Records are appended, a rewritten record reuses its old place when it
+// still fits. The index lives in memory only, so the file is scratch space
+// of one session. Not thread-safe, all calls must come from one thread.
+
+class GE_PageStore {
+private:
+	struct Record {
+		long long offset;
+		size_t size;
+		size_t capacity;
+	};
+
+	std::string path;
+	FILE *file = NULL;
+	long long fileSize = 0;
+	std::unordered_map<long long, Record> records;
+
+public:
+	GE_PageStore() {
+	}
+
+	~GE_PageStore() {
+		close();
+	}
+
+	GE_PageStore(const GE_PageStore &) = delete;
+	GE_PageStore &operator=(const GE_PageStore &) = delete;
+
+	// Creates an empty store, an existing file is truncated
+	bool open(const char *_path) {
+		close();
+		path = _path;
+		file = fopen(path.c_str(), "w+b");
+		return file != NULL;
+	}
+
+	// Closes and deletes the file
+	void close() {
+		if (file == NULL) {
+			return;
+		}
+		fclose(file);
+		file = NULL;
+		remove(path.c_str());
+		records.clear();
+		fileSize = 0;
+	}
+
+	bool isOpen() const {
+		return file != NULL;
+	}
+
+	bool write(long long key, const std::vector<unsigned char> &data) {
+		if (file == NULL) {
+			return false;
+		}
+		auto it = records.find(key);
+		Record record;
+		if (it != records.end() && it->second.capacity >= data.size()) {
+			record = it->second;
+		} else {
+			record.offset = fileSize;
+			record.capacity = data.size();
+		}
+		record.size = data.size();
+		// Flushed, so a full disk fails here and not in a later read
+		if (GE_FileSeek(file, record.offset, SEEK_SET) != 0 || fwrite(data.data(), 1, data.size(), file) != data.size() || fflush(file) != 0) {
+			return false;
+		}
+		if (record.offset == fileSize) {
+			fileSize += record.capacity;
+		}
+		records[key] = record;
+		return true;
+	}
+
+	// Returns false if the key was never written or reading failed
+	bool read(long long key, std::vector<unsigned char> &data) {
+		auto it = records.find(key);
+		if (file == NULL || it == records.end()) {
+			return false;
+		}
+		data.resize(it->second.size);
+		return GE_FileSeek(file, it->second.offset, SEEK_SET) == 0 && fread(data.data(), 1, data.size(), file) == data.size();
+	}
+
+	long long bytesOnDisk() const {
+		return fileSize;
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef GE_PALETTERLE_H
+#define GE_PALETTERLE_H
+
+#include <stddef.h>
+#include <vector>
+
+// Run-length encoding of byte cells over a palette of the values they use.
+// Layout: palette size, palette values, then runs of palette index and
+// length - 1 (16-bit little-endian). Solid and layered volumes shrink to a
+// few runs, decoding walks runs without expanding the cells.
+
+static const size_t GE_PALETTE_RLE_MAX_RUN = 65536;
+
+inline void GE_PaletteRLE_Encode(const unsigned char *cells, size_t count, std::vector<unsigned char> &out) {
+	unsigned char paletteIndex[256];
+	unsigned char palette[256];
+	int paletteSize = 0;
+	bool used[256] = { false };
+	for (size_t i = 0; i < count; i++) {
+		if (!used[cells[i]]) {
+			used[cells[i]] = true;
+			paletteIndex[cells[i]] = (unsigned char)paletteSize;
+			palette[paletteSize++] = cells[i];
+		}
+	}
+
+	out.clear();
+	out.push_back((unsigned char)(paletteSize - 1)); // 1 to 256 values
+	out.insert(out.end(), palette, palette + paletteSize);
+	size_t i = 0;
+	while (i < count) {
+		size_t length = 1;
+		while (i + length < count && cells[i + length] == cells[i] && length < GE_PALETTE_RLE_MAX_RUN) {
+			length++;
+		}
+		out.push_back(paletteIndex[cells[i]]);
+		out.push_back((unsigned char)((length - 1) & 0xFF));
+		out.push_back((unsigned char)((length - 1) >> 8));
+		i += length;
+	}
+}
+
+// Calls run(first, length, value) for every run, returns false without calling it if the data is
+// malformed or its runs do not cover exactly cellCount cells, so corrupt data never indexes past them
+template <typename RunFunc>
+inline bool GE_PaletteRLE_Decode(const std::vector<unsigned char> &data, size_t cellCount, RunFunc run) {
+	if (data.empty()) {
+		return false;
+	}
+	size_t paletteSize = (size_t)data[0] + 1;
+	if (data.size() < 1 + paletteSize || (data.size() - 1 - paletteSize) % 3 != 0) {
+		return false;
+	}
+	size_t covered = 0;
+	for (size_t i = 1 + paletteSize; i < data.size(); i += 3) {
+		size_t length = ((size_t)data[i + 1] | ((size_t)data[i + 2] << 8)) + 1;
+		if (data[i] >= paletteSize || length > cellCount - covered) {
+			return false;
+		}
+		covered += length;
+	}
+	if (covered != cellCount) {
+		return false;
+	}
+
+	const unsigned char *palette = data.data() + 1;
+	size_t first = 0;
+	for (size_t i = 1 + paletteSize; i < data.size(); i += 3) {
+		size_t length = ((size_t)data[i + 1] | ((size_t)data[i + 2] << 8)) + 1;
+		run(first, length, palette[data[i]]);
+		first += length;
+	}
+	return true;
+}
+
+#endif
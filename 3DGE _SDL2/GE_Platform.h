@@ -0,0 +1,59 @@
+#ifndef GE_PLATFORM_H
+#define GE_PLATFORM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+	#include <psapi.h>
+	#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__) && defined(__MACH__)
+	#include <mach/mach.h>
+#else
+	#include <unistd.h>
+#endif
+
+// Resident set size of the current process in bytes, 0 if unknown
+inline size_t GE_GetResidentMemoryBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__APPLE__) && defined(__MACH__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+		return info.resident_size;
+	}
+	return 0;
+#else
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL) {
+		return 0;
+	}
+	long pages = 0;
+	long residentPages = 0;
+	if (fscanf(f, "%ld %ld", &pages, &residentPages) != 2) {
+		residentPages = 0;
+	}
+	fclose(f);
+	return (size_t)residentPages * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// fseek with a 64-bit offset, long is 32 bits on Windows and would wrap past 2 GB
+inline int GE_FileSeek(FILE *file, long long offset, int origin) {
+#ifdef _WIN32
+	return _fseeki64(file, offset, origin);
+#else
+	return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+#endif
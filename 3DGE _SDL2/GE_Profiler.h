@@ -0,0 +1,188 @@
+#ifndef GE_PROFILER_H
+#define GE_PROFILER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Lightweight in-engine profiler.
+// Every thread records into its own ring buffer, so only the newest events are kept
+// and a long session never grows memory. Timeline can be dumped as CSV or as
+// Chrome trace-event JSON (chrome://tracing, Perfetto).
+
+struct GE_ProfileEvent {
+	const char *name = nullptr; // Must point to a string literal
+	unsigned long frame = 0;
+	long long startNs = 0;
+	long long durationNs = 0;
+	double value = 0.0;
+	bool isCounter = false;
+};
+
+struct GE_ProfileThreadBuffer {
+	int threadIndex = 0;
+	std::string threadName;
+	std::mutex lock; // Uncontended except while exporting
+	std::vector<GE_ProfileEvent> ring;
+	size_t head = 0;
+	size_t count = 0;
+};
+
+class GE_Profiler {
+private:
+	std::mutex buffersLock;
+	std::vector<std::unique_ptr<GE_ProfileThreadBuffer>> buffers;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	std::atomic<unsigned long> frame{ 0 };
+	size_t eventsPerThread = 1 << 16;
+
+	GE_ProfileThreadBuffer &threadBuffer() {
+		thread_local GE_ProfileThreadBuffer *buffer = nullptr;
+		if (buffer == nullptr) {
+			std::lock_guard<std::mutex> guard(buffersLock);
+			buffers.emplace_back(new GE_ProfileThreadBuffer());
+			buffer = buffers.back().get();
+			buffer->threadIndex = (int)buffers.size();
+			buffer->threadName = buffers.size() == 1 ? "main" : "worker " + std::to_string(buffers.size() - 1);
+			buffer->ring.resize(eventsPerThread);
+		}
+		return *buffer;
+	}
+
+	void push(GE_ProfileEvent &e) {
+		GE_ProfileThreadBuffer &buffer = threadBuffer();
+		std::lock_guard<std::mutex> guard(buffer.lock);
+		buffer.ring[(buffer.head + buffer.count) % buffer.ring.size()] = e;
+		if (buffer.count < buffer.ring.size()) {
+			buffer.count++;
+		} else {
+			buffer.head = (buffer.head + 1) % buffer.ring.size();
+		}
+	}
+
+	template <typename F>
+	void forEachEvent(F f) {
+		std::lock_guard<std::mutex> guard(buffersLock);
+		for (std::unique_ptr<GE_ProfileThreadBuffer> &buffer : buffers) {
+			std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+			for (size_t i = 0; i < buffer->count; i++) {
+				f(*buffer, buffer->ring[(buffer->head + i) % buffer->ring.size()]);
+			}
+		}
+	}
+
+public:
+	bool enabled = true;
+
+	long long now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	unsigned long beginFrame() {
+		return ++frame;
+	}
+
+	unsigned long currentFrame() {
+		return frame;
+	}
+
+	void setThreadName(const char *name) {
+		threadBuffer().threadName = name;
+	}
+
+	void recordZone(const char *name, long long startNs, long long durationNs) {
+		if (!enabled) {
+			return;
+		}
+		GE_ProfileEvent e;
+		e.name = name;
+		e.frame = frame;
+		e.startNs = startNs;
+		e.durationNs = durationNs;
+		push(e);
+	}
+
+	void recordCounter(const char *name, double value) {
+		if (!enabled) {
+			return;
+		}
+		GE_ProfileEvent e;
+		e.name = name;
+		e.frame = frame;
+		e.startNs = now();
+		e.value = value;
+		e.isCounter = true;
+		push(e);
+	}
+
+	bool writeCSV(const char *path) {
+		FILE *f = fopen(path, "w");
+		if (f == nullptr) {
+			return false;
+		}
+		fprintf(f, "type,frame,thread,thread_name,name,start_us,duration_us,value\n");
+		forEachEvent([&](GE_ProfileThreadBuffer &buffer, GE_ProfileEvent &e) {
+			fprintf(f, "%s,%lu,%d,%s,%s,%.3f,%.3f,%.3f\n",
+				e.isCounter ? "counter" : "zone", e.frame, buffer.threadIndex, buffer.threadName.c_str(), e.name,
+				e.startNs / 1000.0, e.durationNs / 1000.0, e.value);
+		});
+		fclose(f);
+		return true;
+	}
+
+	bool writeChromeTrace(const char *path) {
+		FILE *f = fopen(path, "w");
+		if (f == nullptr) {
+			return false;
+		}
+		fprintf(f, "{\"traceEvents\":[\n");
+		bool first = true;
+		int lastThread = -1;
+		forEachEvent([&](GE_ProfileThreadBuffer &buffer, GE_ProfileEvent &e) {
+			if (buffer.threadIndex != lastThread) {
+				lastThread = buffer.threadIndex;
+				fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+					first ? "" : ",\n", buffer.threadIndex, buffer.threadName.c_str());
+				first = false;
+			}
+			if (e.isCounter) {
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%.3f}}",
+					e.name, e.startNs / 1000.0, buffer.threadIndex, e.value);
+			} else {
+				fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%lu}}",
+					e.name, e.startNs / 1000.0, e.durationNs / 1000.0, buffer.threadIndex, e.frame);
+			}
+		});
+		fprintf(f, "\n]}\n");
+		fclose(f);
+		return true;
+	}
+};
+
+// Times enclosing scope, optionally adding elapsed milliseconds to *accumulateMs
+class GE_ProfileScope {
+private:
+	GE_Profiler &profiler;
+	const char *name;
+	double *accumulateMs;
+	long long start;
+
+public:
+	GE_ProfileScope(GE_Profiler &_profiler, const char *_name, double *_accumulateMs = nullptr)
+		: profiler(_profiler), name(_name), accumulateMs(_accumulateMs), start(_profiler.now()) {
+	}
+
+	~GE_ProfileScope() {
+		long long duration = profiler.now() - start;
+		profiler.recordZone(name, start, duration);
+		if (accumulateMs != nullptr) {
+			*accumulateMs += duration / 1000000.0;
+		}
+	}
+};
+
+#endif
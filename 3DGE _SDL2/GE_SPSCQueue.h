@@ -0,0 +1,75 @@
+#ifndef GE_SPSCQUEUE_H
+#define GE_SPSCQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// Lock-free FIFO between exactly one producer thread and one consumer thread.
+// Ring of a power of two slots, each index is written by one side only and
+// published with release, so neither side ever waits on the other. Full and
+// empty are reported instead of blocking, callers decide how to wait.
+
+template <typename T>
+class GE_SPSCQueue {
+private:
+	std::vector<T> slots;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head{ 0 }; // Next slot to pop, written by the consumer
+	alignas(64) std::atomic<size_t> tail{ 0 }; // Next slot to push, written by the producer
+
+	static size_t RoundUpToPowerOfTwo(size_t n) {
+		size_t size = 1;
+		while (size < n) {
+			size <<= 1;
+		}
+		return size;
+	}
+
+public:
+	explicit GE_SPSCQueue(size_t capacity = 64) : slots(RoundUpToPowerOfTwo(capacity > 0 ? capacity : 1)), mask(slots.size() - 1) {
+	}
+
+	GE_SPSCQueue(const GE_SPSCQueue &) = delete;
+	GE_SPSCQueue &operator=(const GE_SPSCQueue &) = delete;
+
+	// Producer only, returns false if the queue is full and leaves item untouched
+	bool tryPush(T &&item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size()) {
+			return false;
+		}
+		slots[t & mask] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPush(const T &item) {
+		T copy = item;
+		return tryPush(std::move(copy));
+	}
+
+	// Consumer only, returns false if the queue is empty
+	bool tryPop(T &item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = std::move(slots[h & mask]);
+		slots[h & mask] = T(); // Releases what the item holds on the consumer side
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Either side, exact only while the other side is idle
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return slots.size();
+	}
+};
+
+#endif
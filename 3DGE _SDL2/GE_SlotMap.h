@@ -0,0 +1,148 @@
+#ifndef GE_SLOTMAP_H
+#define GE_SLOTMAP_H
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+// Generational slot map: values stay packed in one vector for iteration,
+// handles go through a slot table and stay valid while the vector grows or
+// other values are removed. Removing a value bumps the generation of its
+// slot, so stale handles are detected instead of pointing at a new value.
+
+struct GE_SlotHandle {
+	unsigned int index = ~0u;
+	unsigned int generation = 0;
+
+	bool operator==(const GE_SlotHandle &other) const {
+		return index == other.index && generation == other.generation;
+	}
+	bool operator!=(const GE_SlotHandle &other) const {
+		return !(*this == other);
+	}
+};
+
+template <typename T>
+class GE_SlotMap {
+private:
+	static const unsigned int NONE = ~0u;
+
+	struct Slot {
+		unsigned int dense = NONE; // Index into values, next free slot while unused
+		unsigned int generation = 0;
+	};
+
+	std::vector<T> values;
+	std::vector<unsigned int> valueSlots; // Slot of every value, used to fix the slot of a moved value
+	std::vector<Slot> slots;
+	unsigned int freeHead = NONE;
+
+public:
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+	GE_SlotHandle insert(const T &value) {
+		unsigned int slotIndex;
+		if (freeHead != NONE) {
+			slotIndex = freeHead;
+			freeHead = slots[slotIndex].dense;
+		} else {
+			slotIndex = (unsigned int)slots.size();
+			slots.push_back(Slot());
+		}
+		Slot &slot = slots[slotIndex];
+		slot.dense = (unsigned int)values.size();
+		values.push_back(value);
+		valueSlots.push_back(slotIndex);
+
+		GE_SlotHandle handle;
+		handle.index = slotIndex;
+		handle.generation = slot.generation;
+		return handle;
+	}
+
+	// Last value takes the freed place, so removal never shifts anything
+	bool remove(GE_SlotHandle handle) {
+		if (!contains(handle)) {
+			return false;
+		}
+		Slot &slot = slots[handle.index];
+		unsigned int dense = slot.dense;
+		if (dense != values.size() - 1) {
+			values[dense] = std::move(values.back());
+			valueSlots[dense] = valueSlots.back();
+			slots[valueSlots[dense]].dense = dense;
+		}
+		values.pop_back();
+		valueSlots.pop_back();
+
+		slot.generation++;
+		slot.dense = freeHead;
+		freeHead = handle.index;
+		return true;
+	}
+
+	bool contains(GE_SlotHandle handle) const {
+		// Free slots are a generation ahead of every handle given out for them
+		return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+	}
+
+	// Pointer stays valid until the next insert or remove, keep the handle instead
+	T *get(GE_SlotHandle handle) {
+		return contains(handle) ? &values[slots[handle.index].dense] : nullptr;
+	}
+
+	const T *get(GE_SlotHandle handle) const {
+		return contains(handle) ? &values[slots[handle.index].dense] : nullptr;
+	}
+
+	// Handle of the value at position i of the packed order
+	GE_SlotHandle handleAt(size_t i) const {
+		GE_SlotHandle handle;
+		handle.index = valueSlots[i];
+		handle.generation = slots[handle.index].generation;
+		return handle;
+	}
+
+	void reserve(size_t count) {
+		values.reserve(count);
+		valueSlots.reserve(count);
+		slots.reserve(count);
+	}
+
+	// Frees spare capacity of the values, the slot table keeps its size so old handles stay detectable
+	void shrink_to_fit() {
+		values.shrink_to_fit();
+		valueSlots.shrink_to_fit();
+	}
+
+	size_t size() const {
+		return values.size();
+	}
+
+	bool empty() const {
+		return values.empty();
+	}
+
+	T &front() {
+		return values.front();
+	}
+
+	iterator begin() {
+		return values.begin();
+	}
+
+	iterator end() {
+		return values.end();
+	}
+
+	const_iterator begin() const {
+		return values.begin();
+	}
+
+	const_iterator end() const {
+		return values.end();
+	}
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef GE_SPANBUFFER_H
+#define GE_SPANBUFFER_H
+
+#include <algorithm>
+#include <vector>
+
+// Covered spans per scanline for front to back drawing (S-buffer).
+// Spans of a row are kept sorted and merged with their neighbours. A new
+// span only draws the parts no earlier span covered, so every pixel is
+// written once, and rows covered end to end reject whatever comes later.
+
+class GE_SpanBuffer {
+private:
+	struct Span {
+		int x0, x1; // Inclusive
+	};
+
+	std::vector<std::vector<Span>> rows;
+	int width = 0;
+	int fullRows = 0;
+
+public:
+	// Row vectors keep their capacity between frames
+	void reset(int _width, int height) {
+		width = _width;
+		rows.resize(height);
+		for (std::vector<Span> &row : rows) {
+			row.clear();
+		}
+		fullRows = 0;
+	}
+
+	int height() const {
+		return (int)rows.size();
+	}
+
+	bool isRowFull(int y) const {
+		const std::vector<Span> &row = rows[y];
+		return row.size() == 1 && row[0].x0 <= 0 && row[0].x1 >= width - 1;
+	}
+
+	bool isFull() const {
+		return fullRows == (int)rows.size();
+	}
+
+	// True when every row from y0 to y1 is covered end to end
+	bool areRowsFull(int y0, int y1) const {
+		y0 = std::max(y0, 0);
+		y1 = std::min(y1, height() - 1);
+		for (int y = y0; y <= y1; y++) {
+			if (!isRowFull(y)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Calls draw(x0, x1) for every part of [x0, x1] on row y that is not covered yet
+	template <typename DrawFunc>
+	void forEachUncovered(int y, int x0, int x1, DrawFunc draw) const {
+		const std::vector<Span> &row = rows[y];
+		auto it = std::lower_bound(row.begin(), row.end(), x0, [](const Span &s, int x) { return s.x1 < x; });
+		int x = x0;
+		for (; it != row.end() && it->x0 <= x1; ++it) {
+			if (it->x0 > x) {
+				draw(x, it->x0 - 1);
+			}
+			x = std::max(x, it->x1 + 1);
+			if (x > x1) {
+				return;
+			}
+		}
+		draw(x, x1);
+	}
+
+	void cover(int y, int x0, int x1) {
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, width - 1);
+		if (x0 > x1) {
+			return;
+		}
+		std::vector<Span> &row = rows[y];
+		bool wasFull = isRowFull(y);
+
+		// Spans overlapping or touching [x0, x1] are merged into one
+		auto first = std::lower_bound(row.begin(), row.end(), x0, [](const Span &s, int x) { return s.x1 + 1 < x; });
+		auto last = first;
+		while (last != row.end() && last->x0 <= x1 + 1) {
+			x0 = std::min(x0, last->x0);
+			x1 = std::max(x1, last->x1);
+			++last;
+		}
+		if (first == last) {
+			row.insert(first, Span{ x0, x1 });
+		} else {
+			first->x0 = x0;
+			first->x1 = x1;
+			row.erase(first + 1, last);
+		}
+		if (!wasFull && isRowFull(y)) {
+			fullRows++;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef GE_STREAMWRITER_H
+#define GE_STREAMWRITER_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+
+// Buffered file output for exporters.
+// Output is collected in one fixed-size buffer and handed to fwrite in large
+// sequential chunks, so memory use does not depend on the size of the file.
+
+class GE_StreamWriter {
+private:
+	FILE *file = NULL;
+	std::vector<char> buffer;
+	size_t used = 0;
+	unsigned long long written = 0;
+	bool failed = false;
+
+	void flush() {
+		if (used > 0 && file != NULL && !failed) {
+			failed = fwrite(buffer.data(), 1, used, file) != used;
+			written += used;
+		}
+		used = 0;
+	}
+
+public:
+	explicit GE_StreamWriter(size_t capacity = 1 << 20) : buffer(capacity) {
+	}
+
+	~GE_StreamWriter() {
+		close();
+	}
+
+	GE_StreamWriter(const GE_StreamWriter &) = delete;
+	GE_StreamWriter &operator=(const GE_StreamWriter &) = delete;
+
+	bool open(const char *path) {
+		close();
+		file = fopen(path, "wb");
+		failed = file == NULL;
+		written = 0;
+		return !failed;
+	}
+
+	// Returns false if anything failed since open
+	bool close() {
+		if (file == NULL) {
+			return !failed;
+		}
+		flush();
+		failed = fclose(file) != 0 || failed;
+		file = NULL;
+		return !failed;
+	}
+
+	void write(const void *data, size_t size) {
+		if (used + size > buffer.size()) {
+			flush();
+			if (size > buffer.size()) {
+				failed = failed || file == NULL || fwrite(data, 1, size, file) != size;
+				written += size;
+				return;
+			}
+		}
+		memcpy(buffer.data() + used, data, size);
+		used += size;
+	}
+
+	// Raw bytes of a value, binary formats written by this are little-endian on x86 and ARM only
+	template <typename T>
+	void writeValue(const T &value) {
+		write(&value, sizeof(value));
+	}
+
+	void print(const char *format, ...) {
+		for (int attempt = 0; attempt < 2; attempt++) {
+			va_list args;
+			va_start(args, format);
+			int length = vsnprintf(buffer.data() + used, buffer.size() - used, format, args);
+			va_end(args);
+			if (length < 0) {
+				failed = true;
+				return;
+			}
+			if (used + length < buffer.size()) {
+				used += length;
+				return;
+			}
+			// Did not fit, retry into an empty buffer
+			flush();
+		}
+		failed = true; // Longer than the whole buffer
+	}
+
+	unsigned long long bytesWritten() {
+		return written + used;
+	}
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef GE_THREADPOOL_H
+#define GE_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads taking jobs in FIFO order.
+// Jobs must not touch state the main thread mutates, they work on snapshots
+// and hand their results back (see Engine3D region rebuilding).
+
+class GE_ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex lock;
+	std::condition_variable jobAvailable;
+	std::condition_variable idle;
+	size_t running = 0;
+	bool stopping = false;
+
+	void workerLoop() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				jobAvailable.wait(guard, [this]() { return stopping || !jobs.empty(); });
+				if (jobs.empty()) {
+					return;
+				}
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				running++;
+			}
+			job();
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				running--;
+				if (running == 0 && jobs.empty()) {
+					idle.notify_all();
+				}
+			}
+		}
+	}
+
+public:
+	// 0 threads means one less than hardware threads (main thread keeps a core), at least 1
+	explicit GE_ThreadPool(unsigned int threads = 0) {
+		if (threads == 0) {
+			unsigned int hardware = std::thread::hardware_concurrency();
+			threads = hardware > 1 ? hardware - 1 : 1;
+		}
+		for (unsigned int i = 0; i < threads; i++) {
+			workers.emplace_back(&GE_ThreadPool::workerLoop, this);
+		}
+	}
+
+	~GE_ThreadPool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+		for (std::thread &worker : workers) {
+			worker.join();
+		}
+	}
+
+	GE_ThreadPool(const GE_ThreadPool &) = delete;
+	GE_ThreadPool &operator=(const GE_ThreadPool &) = delete;
+
+	size_t threadCount() {
+		return workers.size();
+	}
+
+	void enqueue(std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.push_back(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	// Blocks until the queue is empty and no job is running
+	void waitIdle() {
+		std::unique_lock<std::mutex> guard(lock);
+		idle.wait(guard, [this]() { return running == 0 && jobs.empty(); });
+	}
+};
+
+#endif
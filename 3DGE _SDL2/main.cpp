@@ -7,10 +7,29 @@
 //
 
 #include <iostream>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
 #include <algorithm>
 #include <vector>
-#include <list>
+#include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include "GE_3DMath.h"
+#include "GE_Profiler.h"
+#include "GE_Platform.h"
+#include "GE_ThreadPool.h"
+#include "GE_BoundedQueue.h"
+#include "GE_SlotMap.h"
+#include "GE_StreamWriter.h"
+#include "GE_BVH.h"
+#include "GE_PageStore.h"
+#include "GE_PaletteRLE.h"
+#include "GE_SpanBuffer.h"
+#include "GE_SPSCQueue.h"
 #ifdef _WIN32
 	//define something for Windows (32-bit and 64-bit, this part is common)
 	#include <SDL.h>
@@ -20,12 +39,66 @@
 #endif
 
 
+struct GE_LaunchOptions {
+	const char *profilePrefix = nullptr; // Writes <prefix>.csv and <prefix>.json on exit
+	bool showProfilerOverlay = false;
+	bool headless = false; // No window, frames are rendered into an offscreen surface
+	const char *recordPath = nullptr; // Records key events of live session
+	const char *replayPath = nullptr; // Replays recorded key events headlessly
+	const char *replayCSVPath = nullptr; // Per-frame replay stats
+	bool replayHash = false; // Prints hash of the scene after replay
+	bool benchScenes = false; // Runs scene-size scaling benchmarks headlessly
+	const char *benchScenesPath = nullptr; // Benchmark results as CSV, "-" for stdout
+	const char *benchBaselinePath = nullptr; // Results of a previous run to compare with
+	double benchThreshold = 0.25; // Allowed relative slowdown against baseline
+	unsigned long benchMaxBlocks = 1000000;
+	int benchFrames = 10;
+	bool benchKernels = false; // Runs math and raster microbenchmarks
+	const char *benchKernelsPath = nullptr; // Microbenchmark results as CSV, "-" for stdout
+	const char *goldenPath = nullptr; // Golden image hashes to compare with
+	const char *importPath = nullptr; // Wavefront OBJ model, placed with M or the mesh edit command
+	const char *editScriptPath = nullptr; // Applies an edit script headlessly, "-" reads stdin
+	unsigned long editBatch = 100000; // Edits applied between region rebuild dispatches
+	float renderScale = 0.0f; // Fixed render resolution scale, 0 lets the live session adapt it to the frame budget
+	float renderScaleMin = 0.5f; // Limits of the adaptive scale
+	float renderScaleMax = 1.0f;
+	double frameBudgetMs = 0.0; // Frame time the adaptive scale aims for, 0 means 1000 / FRAMES_PER_SECOND
+	const char *exportPath = nullptr; // Scene export written after --edit-script or --replay and by F5, .ply or .obj
+	bool pipelined = false; // Builds geometry of next frame on its own thread while current one is rasterized
+	bool spanBuffer = false; // Shaded style is drawn front to back through a span buffer instead of back to front
+	bool gridOrder = false; // Painter's order from walking block cells by distance to the camera cell instead of sorting triangles
+	bool editThread = false; // Keys and edits are applied on their own thread, the renderer draws published scene snapshots
+	double pageBudgetMB = 0.0; // Memory for resident regions, regions beyond it are written to the page store, 0 keeps everything
+	int pageRadius = 4; // Regions around the camera (and its predicted position) that are kept or loaded
+	const char *pageStorePath = "3dge_pages.bin"; // Scratch file of paged out regions, deleted on exit
+	int compressAfterFrames = 120; // Regions not edited for this many frames are kept compressed, negative keeps them expanded
+	bool goldenUpdate = false; // Writes golden hashes instead of comparing
+};
+
 class Engine3D {
 private:
+	GE_LaunchOptions GE_OPTIONS;
+
+	// Edit messages are printed on every change, benchmarks turn them off
+	static bool GE_LOG_EDITS;
+
+	static void LogEdit(const char *format, ...) {
+		if (!GE_LOG_EDITS) {
+			return;
+		}
+		va_list args;
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+	}
+
 	enum class ERROR_CODES {
 		ZERO, // No errors
 		WINDOW_INIT_ERROR, // Error while window initialization
-		SDL2_INIT_ERROR // Error while SDL2 initialization
+		SDL2_INIT_ERROR, // Error while SDL2 initialization
+		HEADLESS_INIT_ERROR, // Error while offscreen surface initialization
+		MESH_IMPORT_ERROR, // Error while loading --import model
+		PAGE_STORE_ERROR // Error while creating the page store file
 	};
 	ERROR_CODES GE_ERROR_CODE = ERROR_CODES::ZERO;
 
@@ -43,10 +116,18 @@ private:
 	};
 	RENDERING_STYLES GE_RENDERING_STYLE = RENDERING_STYLES::STD_SHADED;
 
+	// Stages a style needs, known at compile time so every style gets its own pipeline without per-triangle branches
+	template <RENDERING_STYLES Style>
+	struct GE_StyleTraits {
+		static constexpr bool FILL = Style != RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS; // Filled faces need lighting and back to front order
+		static constexpr bool OUTLINE = Style != RENDERING_STYLES::STD_SHADED;
+	};
+
 	enum class GE_OBJECT_TYPE {
 		UNDEFINED,
 		SELECTOR,
-		CUBE
+		CUBE,
+		MESH // Imported model, placed through GE_MeshInstance
 	};
 
 	enum class GE_MESH_SIDE_TYPE {
@@ -59,6 +140,17 @@ private:
 		BOTTOM
 	};
 
+	// Side visibility is kept as a bit mask, one bit per side type
+	static int SideIndex(GE_MESH_SIDE_TYPE type) {
+		return (int)type - 1;
+	}
+
+	static unsigned char SideBit(GE_MESH_SIDE_TYPE type) {
+		return type == GE_MESH_SIDE_TYPE::UNDEFINED ? 0 : (unsigned char)(1 << SideIndex(type));
+	}
+
+	static const unsigned char GE_ALL_SIDES = 0x3F;
+
 	struct GE_Color {
 		float R;
 		float G;
@@ -114,26 +206,111 @@ private:
 				default: return Types::WHITE; break;
 			}
 		}
+		const char *getColorName(Types t) {
+			// Invalid type will return "white"
+			switch (t) {
+				case Types::WHITE: return "white"; break;
+				case Types::YELLOW: return "yellow"; break;
+				case Types::BLUE: return "blue"; break;
+				case Types::AQUA: return "aqua"; break;
+				case Types::VIOLET: return "violet"; break;
+				case Types::PURPLE: return "purple"; break;
+				case Types::GREEN: return "green"; break;
+				case Types::RED: return "red"; break;
+				default: return "white"; break;
+			}
+		}
+		static const int COUNT = (int)Types::RED + 1;
 	};
 	Colors GE_COLORS;
 
 	struct Triangle {
 		vec3 p[3];
 		GE_Color color = { 255.0f, 255.0f, 255.0f };
+		float ao[3] = { 1.0f, 1.0f, 1.0f }; // Per-vertex ambient occlusion factor
+	};
+
+	// Block side between transform and near clip
+	struct GE_Quad {
+		vec3 p[4]; // Side corners in the order of cubeSideCorners
+		float ao[4];
+		GE_Color color;
+		unsigned char side; // Side index
+	};
+
+	// Block side between near clip and screen clip: the projected quad, or the convex polygon the near plane left of it
+	struct GE_SidePolygon {
+		vec3 p[5]; // Going around the side
+		float ao[5];
+		GE_Color color;
+		unsigned char count;
+	};
+
+	// Convex polygon left after screen clipping, a block side or an imported or selector triangle, filled once
+	struct GE_ScreenPolygon {
+		static const int MAX_CORNERS = 9; // A side cut by the near plane and every screen edge
+		vec3 p[MAX_CORNERS];
+		float ao[MAX_CORNERS];
+		GE_Color color;
+		unsigned char count;
 	};
 
-	struct Triangle2D {
-		SDL_Point p[3];
+	// Painter's order key of a side polygon or of a triangle, both go through sort and screen clip with one key
+	struct GE_RasterKey {
+		float depth;
+		unsigned int index; // Into polygonsToRaster or trianglesToRaster
+		bool polygon;
+	};
+
+	// View and screen space entry of the post-transform cache, each valid when its tag equals the tag of the cache
+	struct GE_ViewedVertex {
+		vec3 viewed;
+		vec3 projected;
+		unsigned int viewedTag = 0;
+		unsigned int projectedTag = 0;
+	};
+
+	// Imported triangle between transform and near clip, its corners are entries of the post-transform cache
+	struct GE_CachedTriangle {
+		unsigned int v[3];
+		GE_Color color;
+	};
+
+	struct Triangle_Indexed {
+		unsigned short v[3]; // Indices into vertices of the mesh
+		float ao[3] = { 1.0f, 1.0f, 1.0f };
 	};
 
 	struct Mesh {
-		std::vector<Triangle> polygons; // First is always considered as a selector
+		// Indexed form: every unique vertex is stored once and triangles refer to it,
+		// so the geometry stage transforms a shared vertex once per frame
+		std::vector<vec3> vertices;
+		std::vector<Triangle_Indexed> polygons;
+
+		unsigned short addVertex(const vec3 &v) {
+			for (size_t i = 0; i < vertices.size(); i++) {
+				if (Vector3_Equals(vertices[i], v)) {
+					return (unsigned short)i;
+				}
+			}
+			vertices.push_back(v);
+			return (unsigned short)(vertices.size() - 1);
+		}
+
+		void addTriangle(const Triangle &tri) {
+			Triangle_Indexed t;
+			for (int i = 0; i < 3; i++) {
+				t.v[i] = addVertex(tri.p[i]);
+				t.ao[i] = tri.ao[i];
+			}
+			polygons.push_back(t);
+		}
 	};
 
 	struct Mesh_Side {
 		GE_MESH_SIDE_TYPE type = GE_MESH_SIDE_TYPE::UNDEFINED;
-		bool hidden = false;
-		Mesh mesh;
+		unsigned short first = 0; // Range of polygons in mesh of the object
+		unsigned short count = 0;
 	};
 
 	struct GE_Object {
@@ -141,7 +318,10 @@ private:
 		vec3 position = { 0, 0, 0 };
 		GE_OBJECT_TYPE objType = GE_OBJECT_TYPE::UNDEFINED;
 		Colors::Types colorType = Colors::Types::WHITE;
+		GE_Color color = { 255.0f, 255.0f, 255.0f };
+		unsigned char visibleSides = GE_ALL_SIDES;
 	public:
+		Mesh mesh;
 		std::vector<Mesh_Side> sides;
 
 		vec3 getPosition() {
@@ -160,16 +340,20 @@ private:
 			return colorType;
 		}
 
+		GE_Color getColor() {
+			return color;
+		}
+
+		unsigned char getVisibleSides() {
+			return visibleSides;
+		}
+
 		void moveBy(vec3 v) {
 			position = Vector3_Add(position, v);
-			for (Mesh_Side &side : sides) {
-				for (Triangle &tri : side.mesh.polygons) {
-					for (vec3 &p : tri.p) {
-						p = Vector3_Add(p, v);
-					}
-				}
+			for (vec3 &p : mesh.vertices) {
+				p = Vector3_Add(p, v);
 			}
-			printf("Moved block to %.2f %.2f %.2f\n", position.x, position.y, position.z);
+			LogEdit("Moved block to %.2f %.2f %.2f\n", position.x, position.y, position.z);
 		}
 
 		void moveTo(vec3 v) {
@@ -178,48 +362,147 @@ private:
 		}
 
 		void scaleBy(float k) {
-			for (Mesh_Side &side : sides) {
-				for (Triangle &tri : side.mesh.polygons) {
-					for (vec3 &p : tri.p) {
-						p = Vector3_Mul(p, k);
-					}
-				}
+			for (vec3 &p : mesh.vertices) {
+				p = Vector3_Mul(p, k);
 			}
-			printf("Scaled block by %.2f\n", k);
+			LogEdit("Scaled block by %.2f\n", k);
 		}
 
 		void setColor(GE_Color _color, Colors::Types _t) {
 			colorType = _t;
-			for (Mesh_Side &side : sides) {
-				for (Triangle &tri : side.mesh.polygons) {
-					tri.color = _color;
-				}
-			}
-			printf("Changed color to %.2f %.2f %.2f\n", _color.R, _color.G, _color.B);
+			color = _color;
+			LogEdit("Changed color to %.2f %.2f %.2f\n", _color.R, _color.G, _color.B);
 		}
 
 		void hideSide(GE_MESH_SIDE_TYPE type) {
-			for (Mesh_Side &side : sides) {
-				if (side.type == type) {
-					side.hidden = true;
-					break;
-				}
-			}
+			visibleSides &= ~SideBit(type);
 		}
 
 		void showSide(GE_MESH_SIDE_TYPE type) {
-			for (Mesh_Side &side : sides) {
-				if (side.type == type) {
-					side.hidden = false;
-					break;
-				}
-			}
+			visibleSides |= SideBit(type);
 		}
 	};
-	
+
+	// Placed cube packed into 24 bytes, its triangles come from the shared GE_STD_OBJECTS.CUBE when drawn.
+	// Side mask and AO are derived data, filled in by region builds
+	struct GE_Block {
+		int x, y, z; // Grid cell
+		unsigned char colorType = (unsigned char)Colors::Types::WHITE;
+		unsigned char visibleSides = GE_ALL_SIDES;
+		unsigned long long aoLevels = ~0ull; // 2 bits per side corner (see cubeSideCorners), index into AO_LEVELS
+
+		vec3 getPosition() const {
+			return { (float)x, (float)y, (float)z };
+		}
+
+		void hideSide(GE_MESH_SIDE_TYPE type) {
+			visibleSides &= ~SideBit(type);
+		}
+
+		void showSide(GE_MESH_SIDE_TYPE type) {
+			visibleSides |= SideBit(type);
+		}
+	};
+
+	// Regions of REGION_SIZE^3 cells bake their visible blocks on worker threads
+	static const int REGION_SIZE = 16;
+	static const int REGION_SNAPSHOT_SIZE = REGION_SIZE + 2; // One cell of border on every side
+
+	// Block of a region mesh packed into 12 bytes: cell relative to the region origin, the region's place in the
+	// world goes into the model matrix instead. AO corners take 48 of the 64 bits a GE_Block spends on them
+	struct GE_MeshBlock {
+		unsigned char x, y, z; // 0 to REGION_SIZE - 1
+		unsigned char visibleSides;
+		unsigned char colorType;
+		unsigned short ao[3]; // aoLevels of the block in 16-bit parts, low part first
+
+		vec3 getLocalPosition() const {
+			return { (float)x, (float)y, (float)z };
+		}
+
+		unsigned long long aoLevels() const {
+			return (unsigned long long)ao[0] | ((unsigned long long)ao[1] << 16) | ((unsigned long long)ao[2] << 32);
+		}
+	};
+
+	// Blocks of a region mesh with the same visible sides
+	struct GE_SideGroup {
+		unsigned char sides;
+		unsigned int first, count;
+	};
+
+	struct GE_RegionMesh {
+		int originX, originY, originZ; // First cell of the region
+		std::vector<GE_MeshBlock> visibleBlocks; // Blocks with at least one visible side, side mask and AO resolved, ordered by side mask
+		std::vector<GE_SideGroup> sideGroups;
+		int nearestSide[6]; // Smallest dot(side normal, block position) of blocks showing the side, by side index
+	};
+
+	struct GE_Region {
+		std::shared_ptr<const GE_RegionMesh> mesh; // Last finished build, drawn until a newer one is swapped in
+		unsigned long requestedBuild = 0;
+		unsigned long installedBuild = 0;
+	};
+
+	struct GE_RegionSnapshot {
+		int originX, originY, originZ; // First cell of the snapshot, border included
+		std::vector<unsigned char> cells; // 0 is empty, otherwise color type + 1
+	};
+
+	struct GE_RegionBuildResult {
+		long long regionKey;
+		unsigned long build;
+		std::shared_ptr<const GE_RegionMesh> mesh;
+	};
+
+	// Where the blocks of a region live. Region meshes are separate and stay in memory unless the region is paged out
+	enum class GE_PAGE_STATE {
+		EXPANDED, // In the slot map and the cell map, editable
+		COMPRESSED, // Palette + RLE cells in the page, see CompressInactiveRegions
+		PAGED_OUT, // In the page store only, see UpdateRegionPaging
+		LOADING
+	};
+
+	struct GE_RegionPage {
+		GE_PAGE_STATE state = GE_PAGE_STATE::EXPANDED;
+		unsigned int blockCount = 0; // Kept in every state
+		unsigned long lastUsedFrame = 0; // Last frame the region was near the camera
+		unsigned long lastEditFrame = 0;
+		unsigned long loadSerial = 0; // Only the latest load of the region is installed
+		unsigned int failedReads = 0; // Background loads stop after PAGE_READ_RETRIES, edits still try
+		std::vector<unsigned char> packed; // Cells while compressed
+	};
+
+	struct GE_PageLoadResult {
+		long long regionKey;
+		unsigned long serial; // 0 installs regardless of serial, used to give back cells of a failed write
+		std::vector<unsigned char> packed;
+		bool failed; // Unreadable or corrupt, the region stays paged out
+	};
+
+	// Triangle soup loaded from a model file, shared by all of its instances and never changed after import
+	struct GE_ImportedMesh {
+		std::string name;
+		std::vector<vec3> vertices;
+		std::vector<unsigned int> indices; // Three per triangle
+		GE_BVH bvh;
+	};
+
+	struct GE_MeshInstance {
+		std::shared_ptr<const GE_ImportedMesh> mesh;
+		vec3 position = { 0, 0, 0 };
+		unsigned char colorType = (unsigned char)Colors::Types::WHITE;
+	};
+
 	struct DrawList {
 		GE_Object selectorBox;
-		std::vector<GE_Object> obj;
+		GE_SlotMap<GE_Block> blocks; // Packed for drawing, handles survive growth and removals
+		std::unordered_map<long long, GE_SlotHandle> blockByCell; // Handle into blocks, also answers cell occupancy
+		std::unordered_map<long long, GE_Region> regions;
+		std::unordered_set<long long> dirtyRegions; // Rebuilt on the next dispatch, so edits of one frame coalesce
+		std::unordered_map<long long, GE_RegionPage> regionPages; // Every region holding blocks, resident or not
+		std::vector<std::shared_ptr<const GE_ImportedMesh>> importedMeshes;
+		GE_SlotMap<GE_MeshInstance> meshInstances;
 	};
 	DrawList GE_DRAW_LIST;
 
@@ -247,14 +530,227 @@ private:
 	vec3 LightDirection = { 0.5f, 0.75f, -1.0f }; // LIGHT ORIGIN
 	vec3 ObjectMeshAnchor = { -0.5, -0.5, -0.5 }; // Required for objects to have (0,0,0) in middle of them
 
+	// Ambient occlusion
+	const float AO_LEVELS[4] = { 0.45f, 0.65f, 0.82f, 1.0f }; // Brightness by count of free corner neighbours
+	const int AO_SHADES = 32; // Interpolated AO is quantized to this many steps per scanline run
+
+	// AO slots of the cube template: side corner slot is 4 * side index + corner
+	unsigned short cubeSideCorners[6][4] = { { 0 } }; // Template vertex of every side corner
+	std::vector<unsigned char> cubeAOSlots; // Side corner slot of every template triangle corner
+	unsigned char cubeSideTriangles[6][2][3] = { { { 0 } } }; // Side corner of every corner of the two template triangles of a side
+	unsigned char cubeSideCycle[6][4] = { { 0 } }; // Side corners in order around the side, so a side is drawn as one polygon
+	vec3 cubeSideNormals[6]; // Cross product of a template triangle of every side, the same as the one of its placed copies
+
+	struct GE_SideNeighbour {
+		GE_MESH_SIDE_TYPE sideType;
+		GE_MESH_SIDE_TYPE counterSideType;
+		vec3 offset;
+	};
+	const GE_SideNeighbour SIDE_NEIGHBOURS[6] = {
+		{ GE_MESH_SIDE_TYPE::EAST, GE_MESH_SIDE_TYPE::WEST,		{  1,  0,  0 } },
+		{ GE_MESH_SIDE_TYPE::TOP, GE_MESH_SIDE_TYPE::BOTTOM,	{  0,  1,  0 } },
+		{ GE_MESH_SIDE_TYPE::NORTH, GE_MESH_SIDE_TYPE::SOUTH,	{  0,  0,  1 } },
+		{ GE_MESH_SIDE_TYPE::WEST, GE_MESH_SIDE_TYPE::EAST,		{ -1,  0,  0 } },
+		{ GE_MESH_SIDE_TYPE::BOTTOM, GE_MESH_SIDE_TYPE::TOP,	{  0, -1,  0 } },
+		{ GE_MESH_SIDE_TYPE::SOUTH, GE_MESH_SIDE_TYPE::NORTH,	{  0,  0, -1 } },
+	};
+
+	// Profiling
+	enum class PIPELINE_STAGES {
+		TRANSFORM,
+		BACKFACE_CULL,
+		NEAR_CLIP,
+		SORT,
+		SCREEN_CLIP,
+		RASTER,
+		PRESENT,
+		COUNT
+	};
+	const char *PIPELINE_STAGE_NAMES[(int)PIPELINE_STAGES::COUNT] = { "TRANSFORM", "CULL", "NEAR CLIP", "SORT", "SCREEN CLIP", "RASTER", "PRESENT" };
+
+	struct GE_FrameStats {
+		double stageMs[(int)PIPELINE_STAGES::COUNT] = { 0 };
+		double frameMs = 0;
+		unsigned long trianglesSubmitted = 0;
+		unsigned long trianglesCulled = 0;
+		unsigned long trianglesGroupCulled = 0; // Part of culled, whole side groups of regions facing away, never transformed
+		unsigned long trianglesClipped = 0;
+		unsigned long trianglesDrawn = 0;
+		unsigned long trianglesSkipped = 0; // Imported mesh triangles in BVH nodes outside the frustum
+		unsigned long trianglesOccluded = 0; // Rejected by the span buffer, every row they touch was covered
+		unsigned long long pixelsFilled = 0;
+		double latencyMs = 0; // From taking the frame input to presenting it
+		double inputLatencyMs = 0; // From reading a key to presenting the first frame showing it, 0 on frames without one
+		double inputApplyMs = 0; // From reading that key to the scene having it applied
+	};
+	GE_FrameStats GE_FRAME_STATS; // Collected during current frame
+	GE_FrameStats GE_FRAME_STATS_SMOOTHED; // Shown by overlay
+	GE_Profiler GE_PROFILER;
+	bool showProfilerOverlay = false;
+
+	// Everything the geometry stage reads, copied on the main thread so edits never race with it
+	struct GE_FrameInput {
+		Matrix4 matView;
+		Matrix4 matProj;
+		vec3 cameraPosition;
+		vec3 lightDirection;
+		int width = 0;
+		int height = 0;
+		RENDERING_STYLES style = RENDERING_STYLES::STD_SHADED;
+		bool gridOrder = false; // Blocks only, frames with imported meshes are sorted
+		GE_Object selectorBox;
+		std::vector<std::shared_ptr<const GE_RegionMesh>> regionMeshes;
+		std::vector<GE_MeshInstance> meshInstances;
+		long long inputNs = 0;
+		long long keyNs = 0; // Read time of the oldest key not presented before this frame, 0 if none
+	};
+
+	// Scene state the edit thread publishes for the renderer, never changed once published
+	struct GE_SceneSnapshot {
+		unsigned long version = 0;
+		GE_Camera camera;
+		GE_Object selectorBox;
+		std::vector<std::shared_ptr<const GE_RegionMesh>> regionMeshes;
+		std::vector<GE_MeshInstance> meshInstances;
+		long long keyNs = 0; // Read time of the oldest key first applied in this version, 0 if none
+		long long appliedNs = 0; // When the last of its keys was applied
+		unsigned long syncSerial = 0; // Last sync command done before it was taken
+		double residentMB = 0; // Paging counters, only the edit thread may walk the regions
+		size_t regionsPagedOut = 0;
+	};
+
+	// Key handed from the main thread to the edit thread
+	struct GE_EditCommand {
+		int scancode = 0; // EDIT_SYNC finishes region builds and publishes at once, headless replay waits for it
+		long long keyNs = 0;
+		unsigned long serial = 0;
+	};
+	static const int EDIT_SYNC = -1;
+
+	struct GE_OrderedBlock {
+		GE_MeshBlock block; // Copied, the ordered walk reads blocks in sequence
+		unsigned int region; // Index into the region meshes of the frame input
+		unsigned char sides;
+		unsigned int distance;
+	};
+
+	// Pipeline buffers, every stage writes into its own vector, kept between frames to avoid reallocations
+	struct GE_FrameGeometry {
+		GE_FrameInput input;
+		std::vector<vec3> verticesTransformed; // Post-transform cache of the object being transformed
+		std::vector<unsigned int> verticesTransformedTags; // Entry is valid when its tag equals vertexCacheTag
+		unsigned int vertexCacheTag = 0;
+		// Imported meshes keep their cache until the near clip, which views and projects each vertex once under the same tag
+		std::vector<GE_ViewedVertex> verticesViewed;
+		std::vector<Triangle> trianglesTransformed; // Selector
+		std::vector<GE_CachedTriangle> cachedTransformed; // Imported meshes
+		std::vector<GE_CachedTriangle> cachedLit;
+		std::vector<GE_Quad> quadsTransformed; // Block sides, imported meshes stay triangles
+		std::vector<GE_Quad> quadsLit;
+		std::vector<GE_SidePolygon> polygonsToRaster; // Block sides
+		std::vector<Triangle> trianglesToRaster; // Imported meshes
+		std::vector<GE_RasterKey> rasterOrder; // Both of the above, one key each
+		std::vector<GE_ScreenPolygon> polygonsClipped;
+		std::vector<float> depthsClipped; // Sort depth of every clipped polygon
+		// Grid order: blocks by distance of their cell, and the distance of every quad through the stages
+		std::vector<Matrix4> regionMatrices;
+		std::vector<GE_OrderedBlock> blocksFacing;
+		std::vector<GE_OrderedBlock> blocksOrdered;
+		std::vector<unsigned int> blockDistanceCounts;
+		std::vector<float> distancesTransformed;
+		std::vector<float> distancesLit;
+		// Selector goes through the stages on its own, so it can be redrawn over the world of an earlier frame
+		std::vector<GE_ScreenPolygon> selectorClipped;
+		std::vector<float> selectorDepths;
+		GE_FrameStats stats; // Geometry stage times and counters
+	};
+	// Sequential mode uses the first one, pipelined mode alternates between both
+	GE_FrameGeometry frameGeometry[2];
+
 	const char title[4] = "^_^";
 	const int FRAMES_PER_SECOND = 120;
 
-	int WIDTH, HEIGHT;
+	int WIDTH, HEIGHT; // Render resolution, the output size scaled by renderScale
+	int outputWidth = 0, outputHeight = 0;
+
+	// Dynamic resolution, the scene is rasterized into a smaller target and stretched over the output
+	float renderScale = 1.0f;
+	bool adaptiveRenderScale = false;
+	int framesSinceScaleChange = 0;
+	SDL_Texture *sceneTarget = NULL;
+	int sceneTargetWidth = 0, sceneTargetHeight = 0;
 
 	bool isRunning = false;
 
 	SDL_Window *window = NULL;
+	SDL_Surface *headlessSurface = NULL;
+
+	// Input recording
+	FILE *recordFile = NULL;
+	unsigned long frameIndex = 0;
+
+	// World paging. The store and the evicted cells not written yet are guarded by pageStoreLock, pagingPool
+	// jobs use them in request order and an edit reads its own region directly, see LoadRegionNow
+	GE_PageStore pageStore;
+	std::mutex pageStoreLock;
+	std::unordered_map<long long, std::shared_ptr<const std::vector<unsigned char>>> pageWritesPending;
+	std::mutex pageResultsLock;
+	std::vector<GE_PageLoadResult> pageResults;
+	std::atomic<bool> pageWriteFailed{ false }; // Stops evictions, nothing is paged out without a copy on disk
+	unsigned long pageSerial = 0;
+	unsigned long regionFrame = 0; // Frames seen by UpdateRegionStorage, ages regions for compression and eviction
+	vec3 pagingLastCamera = { 0, 0, 0 };
+	vec3 pagingVelocity = { 0, 0, 0 }; // Smoothed camera movement per frame, prefetching looks ahead along it
+	unsigned long regionsPagedOut = 0;
+	unsigned long regionsPagedIn = 0;
+	unsigned long regionsCompressed = 0;
+	size_t residentBytesPeak = 0;
+	GE_ThreadPool pagingPool{ 1 }; // One thread keeps reads and writes in request order
+
+	// Region rebuilding, the pool is declared last so its jobs finish before anything they use is destroyed
+	unsigned long regionBuildSerial = 0; // Newer builds get bigger numbers, older results never replace newer ones
+	std::mutex regionResultsLock;
+	std::vector<GE_RegionBuildResult> regionResults;
+	GE_ThreadPool regionBuildPool;
+
+	// Pipelined mode, geometry of frame N+1 is built on its own thread while frame N is rasterized
+	std::thread geometryThread;
+	GE_BoundedQueue<GE_FrameGeometry *> geometryJobs{ 1 };
+	GE_BoundedQueue<GE_FrameGeometry *> geometryDone{ 1 };
+	int nextFrameGeometry = 0;
+	bool geometryInFlight = false;
+
+	// Edit thread mode, keys go to the edit thread and scene snapshots come back, both through lock-free queues.
+	// The edit thread owns GE_DRAW_LIST and MainCamera while it runs, the renderer only reads sceneSnapshot
+	std::thread editThread;
+	std::atomic<bool> editThreadStop{ false };
+	std::atomic<unsigned long> framesRendered{ 0 }; // Region storage upkeep runs once per rendered frame
+	GE_SPSCQueue<GE_EditCommand> editCommands{ 256 };
+	GE_SPSCQueue<std::shared_ptr<const GE_SceneSnapshot>> sceneSnapshots{ 8 };
+	std::shared_ptr<const GE_SceneSnapshot> sceneSnapshot; // Newest one taken by the renderer
+	unsigned long editSerial = 0; // Commands posted so far
+	// Oldest key not presented yet, the renderer reports its latency with the first frame showing it
+	long long pendingKeyNs = 0;
+	double pendingKeyApplyMs = 0;
+
+	// World layer: the last full frame stays in sceneTarget. While only the selector changes, the world
+	// is not rebuilt, the screen rectangle the selector covered and covers now is redrawn from layerGeometry
+	GE_FrameInput frameInput;
+	GE_FrameGeometry *layerGeometry = nullptr;
+	SDL_Rect layerSelectorRect = { 0, 0, 0, 0 };
+	// Screen tiles of the layer listing world polygons that overlap them, back to front. Built on the
+	// first selector redraw of a layer, so later redraws only visit polygons near the selector
+	static const int LAYER_TILE_SIZE = 32;
+	std::vector<unsigned int> layerTileStart; // Offsets into layerTilePolygons, one more than tiles
+	std::vector<unsigned int> layerTilePolygons;
+	int layerTilesX = 0, layerTilesY = 0;
+	bool layerTilesValid = false;
+	std::vector<unsigned int> layerRedrawPolygons;
+
+	// Front to back drawing of the shaded style, see DrawSpan
+	GE_SpanBuffer spanBuffer;
+	bool spanBufferActive = false;
+	std::vector<const GE_ScreenPolygon *> spanOrder;
 
 	bool check_window(SDL_Window *window) {
 		if (window == NULL)
@@ -283,18 +779,22 @@ private:
 		// If distance sign is positive, point lies on "inside" of plane
 		vec3 *inside_points[3];  int nInsidePointCount = 0;
 		vec3 *outside_points[3]; int nOutsidePointCount = 0;
+		float inside_ao[3], outside_ao[3];
 
 		// Get signed distance of each point in triangle to plane
 		float d0 = dist(in_tri.p[0]);
 		float d1 = dist(in_tri.p[1]);
 		float d2 = dist(in_tri.p[2]);
 
-		if (d0 >= 0) { inside_points[nInsidePointCount++] = &in_tri.p[0]; }
-		else { outside_points[nOutsidePointCount++] = &in_tri.p[0]; }
-		if (d1 >= 0) { inside_points[nInsidePointCount++] = &in_tri.p[1]; }
-		else { outside_points[nOutsidePointCount++] = &in_tri.p[1]; }
-		if (d2 >= 0) { inside_points[nInsidePointCount++] = &in_tri.p[2]; }
-		else { outside_points[nOutsidePointCount++] = &in_tri.p[2]; }
+		if (d0 >= 0) { inside_ao[nInsidePointCount] = in_tri.ao[0]; inside_points[nInsidePointCount++] = &in_tri.p[0]; }
+		else { outside_ao[nOutsidePointCount] = in_tri.ao[0]; outside_points[nOutsidePointCount++] = &in_tri.p[0]; }
+		if (d1 >= 0) { inside_ao[nInsidePointCount] = in_tri.ao[1]; inside_points[nInsidePointCount++] = &in_tri.p[1]; }
+		else { outside_ao[nOutsidePointCount] = in_tri.ao[1]; outside_points[nOutsidePointCount++] = &in_tri.p[1]; }
+		if (d2 >= 0) { inside_ao[nInsidePointCount] = in_tri.ao[2]; inside_points[nInsidePointCount++] = &in_tri.p[2]; }
+		else { outside_ao[nOutsidePointCount] = in_tri.ao[2]; outside_points[nOutsidePointCount++] = &in_tri.p[2]; }
+
+		// Intersection parameter, used to interpolate per-vertex ambient occlusion
+		float t;
 
 		// Now classify triangle points, and break the input triangle into 
 		// smaller output triangles if required. There are four possible
@@ -332,11 +832,14 @@ private:
 
 			// The inside point is valid, so keep that...
 			out_tri1.p[0] = *inside_points[0];
+			out_tri1.ao[0] = inside_ao[0];
 
 			// but the two new points are at the locations where the 
 			// original sides of the triangle (lines) intersect with the plane
-			out_tri1.p[1] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[0]);
-			out_tri1.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[1]);
+			out_tri1.p[1] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[0], t);
+			out_tri1.ao[1] = inside_ao[0] + (outside_ao[0] - inside_ao[0]) * t;
+			out_tri1.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[1], t);
+			out_tri1.ao[2] = inside_ao[0] + (outside_ao[1] - inside_ao[0]) * t;
 
 			return 1; // Return the newly formed single triangle
 		}
@@ -368,14 +871,20 @@ private:
 			// intersects with the plane
 			out_tri1.p[0] = *inside_points[0];
 			out_tri1.p[1] = *inside_points[1];
-			out_tri1.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[0]);
+			out_tri1.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[0], *outside_points[0], t);
+			out_tri1.ao[0] = inside_ao[0];
+			out_tri1.ao[1] = inside_ao[1];
+			out_tri1.ao[2] = inside_ao[0] + (outside_ao[0] - inside_ao[0]) * t;
 
 			// The second triangle is composed of one of he inside points, a
 			// new point determined by the intersection of the other side of the 
 			// triangle and the plane, and the newly created point above
 			out_tri2.p[0] = *inside_points[1];
 			out_tri2.p[1] = out_tri1.p[2];
-			out_tri2.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[1], *outside_points[0]);
+			out_tri2.p[2] = Vector3_IntersectPlane(plane_p, plane_n, *inside_points[1], *outside_points[0], t);
+			out_tri2.ao[0] = inside_ao[1];
+			out_tri2.ao[1] = out_tri1.ao[2];
+			out_tri2.ao[2] = inside_ao[1] + (outside_ao[0] - inside_ao[1]) * t;
 
 			return 2; // Return two newly formed triangles which form a quad
 		}
@@ -383,122 +892,284 @@ private:
         return -1;
 	}
 
+	// Camera the renderer draws with, MainCamera belongs to the edit thread while it runs
+	const GE_Camera &RenderCamera() const {
+		return sceneSnapshot != nullptr ? sceneSnapshot->camera : MainCamera;
+	}
+
+	static vec3 CameraLookDirection(const GE_Camera &camera) {
+		vec3 targetVector = { 0, 0, 1 };
+		Matrix4 matCameraRot = Matrix4_MultiplyMatrix(Matrix4_MakeRotationX(camera.fXRotation), Matrix4_MakeRotationY(camera.fYRotation));
+		return Matrix4_MultiplyVectorAffine(targetVector, matCameraRot);
+	}
+
 	void updateScreenAndCameraProperties(SDL_Renderer *renderer) {
 		// Gets real size of the window(Fix for MacOS/Resizing)
-		SDL_GetRendererOutputSize(renderer, &WIDTH, &HEIGHT);
-		const float fAspectRatio = (float)HEIGHT / (float)WIDTH;
-		matProj = Matrix4_MakeProjection(MainCamera.fFOV, fAspectRatio, MainCamera.fNear, MainCamera.fFar);
+		SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+		WIDTH = std::max(1, (int)lroundf(outputWidth * renderScale));
+		HEIGHT = std::max(1, (int)lroundf(outputHeight * renderScale));
+		const float fAspectRatio = (float)outputHeight / (float)outputWidth;
+		const GE_Camera &camera = RenderCamera();
+		matProj = Matrix4_MakeProjection(camera.fFOV, fAspectRatio, camera.fNear, camera.fFar);
 	}
 
-	void DrawTriangle2D(SDL_Renderer *renderer, Triangle2D tr) {
-		SDL_Point points[4] = { tr.p[0], tr.p[1], tr.p[2], tr.p[0] };
-		SDL_RenderDrawLines(renderer, points, 4);
+	void DrawPolygonOutline2D(SDL_Renderer *renderer, const GE_ScreenPolygon &polygon) {
+		SDL_Point points[GE_ScreenPolygon::MAX_CORNERS + 1];
+		for (int c = 0; c < polygon.count; c++) {
+			points[c] = { (int)polygon.p[c].x, (int)polygon.p[c].y };
+		}
+		points[polygon.count] = points[0];
+		SDL_RenderDrawLines(renderer, points, polygon.count + 1);
 	}
 
-	void DrawTopFlatTriangle(SDL_Renderer *renderer, SDL_Point *v)
-	{
-		/*
-		  0 ---------- 1
-			\	     /
-			 \      /
-			  \	   /
-			   \  /
-			    \/
-				 2
-		*/
-		float dx0 = (float)(v[0].x - v[2].x) / (float)(v[2].y - v[0].y);
-		float dx1 = (float)(v[1].x - v[2].x) / (float)(v[2].y - v[1].y);
-
-		float xOffset0 = v[2].x;
-		float xOffset1 = v[2].x;
-
-		for (int scanlineY = v[2].y; scanlineY >= v[0].y; scanlineY--)
-		{
-			SDL_RenderDrawLine(renderer, xOffset0, scanlineY, xOffset1, scanlineY);
-			xOffset0 += dx0;
-			xOffset1 += dx1;
+	// One scanline of a polygon. With the span buffer on only the uncovered parts are drawn, and the
+	// span is covered right away, so every pixel is written once
+	void DrawSpan(SDL_Renderer *renderer, int scanlineY, int x0, int x1) {
+		if (x0 > x1) {
+			std::swap(x0, x1);
+		}
+		if (!spanBufferActive) {
+			SDL_RenderDrawLine(renderer, x0, scanlineY, x1, scanlineY);
+			GE_FRAME_STATS.pixelsFilled += x1 - x0 + 1;
+			return;
 		}
+		if (scanlineY < 0 || scanlineY >= spanBuffer.height()) {
+			return;
+		}
+		spanBuffer.forEachUncovered(scanlineY, x0, x1, [&](int a, int b) {
+			SDL_RenderDrawLine(renderer, a, scanlineY, b, scanlineY);
+			GE_FRAME_STATS.pixelsFilled += b - a + 1;
+		});
+		spanBuffer.cover(scanlineY, x0, x1);
 	}
 
-	void DrawBottomFlatTriangle(SDL_Renderer *renderer, SDL_Point *v)
-	{
-		/*
-		        0
-		        /\ 
-			   /  \
-		      /    \
-		     /      \
-			/        \
-		  1 ---------- 2
-		*/
-		float dx0 = (float)(v[1].x - v[0].x) / (float)(v[1].y - v[0].y);
-		float dx1 = (float)(v[2].x - v[0].x) / (float)(v[2].y - v[0].y);
-
-		float xOffset0 = v[0].x;
-		float xOffset1 = v[0].x;
-
-		for (int scanlineY = v[0].y; scanlineY <= v[1].y; scanlineY++)
-		{
-			SDL_RenderDrawLine(renderer, xOffset0, scanlineY, xOffset1, scanlineY);
-			xOffset0 += dx0;
-			xOffset1 += dx1;
+	void DrawShadedScanline(SDL_Renderer *renderer, int scanlineY, float xA, float xB, float aoA, float aoB, GE_Color &color) {
+		if (xA > xB) {
+			std::swap(xA, xB);
+			std::swap(aoA, aoB);
+		}
+		int x0 = (int)xA;
+		int x1 = (int)xB;
+		float dao = (x1 > x0) ? (aoB - aoA) / (float)(x1 - x0) : 0.0f;
+
+		// Pixels are grouped into runs of equal quantized shade, so a line is drawn per run instead of per pixel
+		float ao = aoA;
+		int runStart = x0;
+		int runShade = (int)(aoA * AO_SHADES + 0.5f);
+		for (int x = x0 + 1; x <= x1 + 1; x++) {
+			ao += dao;
+			int shade = (x <= x1) ? (int)(ao * AO_SHADES + 0.5f) : -1;
+			if (shade != runShade) {
+				float k = (float)runShade / (float)AO_SHADES;
+				SDL_SetRenderDrawColor(renderer, color.R * k, color.G * k, color.B * k, 255);
+				DrawSpan(renderer, scanlineY, runStart, x - 1);
+				runStart = x;
+				runShade = shade;
+			}
 		}
 	}
 
-	void DrawFilledTriangle2D(SDL_Renderer *renderer, Triangle2D tr) {
-		// Points are Integers
-		// p[0] need to have lowest y among points
-		if (!(tr.p[0].y == tr.p[1].y && tr.p[1].y == tr.p[2].y)) {
-			bool sorted = false;
-			while (!sorted)
-			{
-				sorted = true;
-				for (int i = 0; i < 2; i++) {
-					if (tr.p[i].y > tr.p[i + 1].y)
-					{
-						sorted = false;
-						SDL_Point buffPoint = tr.p[i];
-						tr.p[i] = tr.p[i + 1];
-						tr.p[i + 1] = buffPoint;
+	// Convex polygon row by row from its top corner down, between two chains of edges that both end at the
+	// bottom corner. Ambient occlusion is stepped along both chains and across every row, so a block side
+	// is filled once, with no inner edge drawn twice
+	void DrawFilledPolygon2D(SDL_Renderer *renderer, const GE_ScreenPolygon &polygon) {
+		const int count = polygon.count;
+		SDL_Point v[GE_ScreenPolygon::MAX_CORNERS];
+		int top = 0, bottom = 0;
+		bool uniform = true;
+		for (int c = 0; c < count; c++) {
+			v[c] = { (int)polygon.p[c].x, (int)polygon.p[c].y };
+			top = v[c].y < v[top].y ? c : top;
+			bottom = v[c].y > v[bottom].y ? c : bottom;
+			uniform = uniform && polygon.ao[c] == polygon.ao[0];
+		}
+		if (v[top].y == v[bottom].y) {
+			return;
+		}
+		GE_Color color = polygon.color;
+		// Uniform ambient occlusion (the common case) needs one colour for the whole polygon
+		if (uniform) {
+			SDL_SetRenderDrawColor(renderer, color.R * polygon.ao[0], color.G * polygon.ao[0], color.B * polygon.ao[0], 255);
+		}
+
+		// One chain walks the corners forwards, the other backwards
+		const int step[2] = { 1, count - 1 };
+		int from[2] = { top, top }, to[2] = { top, top };
+		float dx[2] = { 0.0f, 0.0f }, dao[2] = { 0.0f, 0.0f };
+		for (int scanlineY = v[top].y; scanlineY <= v[bottom].y; scanlineY++) {
+			float x[2], ao[2];
+			for (int s = 0; s < 2; s++) {
+				// Edges ending on this row are left for the next one, the last edge also draws the bottom row
+				while (to[s] != bottom && v[to[s]].y <= scanlineY) {
+					from[s] = to[s];
+					to[s] = (to[s] + step[s]) % count;
+					int dy = v[to[s]].y - v[from[s]].y;
+					dx[s] = dy > 0 ? (float)(v[to[s]].x - v[from[s]].x) / (float)dy : 0.0f;
+					dao[s] = dy > 0 ? (polygon.ao[to[s]] - polygon.ao[from[s]]) / (float)dy : 0.0f;
+				}
+				float rows = (float)(scanlineY - v[from[s]].y);
+				x[s] = v[from[s]].x + rows * dx[s];
+				ao[s] = polygon.ao[from[s]] + rows * dao[s];
+			}
+			if (uniform) {
+				DrawSpan(renderer, scanlineY, (int)x[0], (int)x[1]);
+			} else {
+				DrawShadedScanline(renderer, scanlineY, x[0], x[1], ao[0], ao[1], color);
+			}
+		}
+	}
+
+	// World has no rotation, only a fixed offset along Z
+	static Matrix4 WorldMatrix() {
+		return Matrix4_MakeTranslation(0.0f, 0.0f, 5.0f);
+	}
+
+	// Templates are centred on the origin, the position of the placed copy goes into the translation
+	static Matrix4 PlaceInWorld(const Matrix4 &matWorld, const vec3 &position) {
+		Matrix4 matPlaced = matWorld;
+		vec3 translation = Matrix4_MultiplyVectorAffine(position, matWorld);
+		matPlaced.m[3][0] = translation.x;
+		matPlaced.m[3][1] = translation.y;
+		matPlaced.m[3][2] = translation.z;
+		return matPlaced;
+	}
+
+	// Post-transform cache: a vertex is transformed the first time a visible triangle uses it,
+	// later triangles of the mesh pick the result up by index. Returns the tag of valid entries
+	unsigned int BeginVertexCache(GE_FrameGeometry &geometry, size_t vertexCount) {
+		if (geometry.verticesTransformed.size() < vertexCount) {
+			geometry.verticesTransformed.resize(vertexCount);
+			geometry.verticesTransformedTags.resize(vertexCount, 0);
+			geometry.verticesViewed.resize(vertexCount);
+		}
+		if (++geometry.vertexCacheTag == 0) {
+			std::fill(geometry.verticesTransformedTags.begin(), geometry.verticesTransformedTags.end(), 0);
+			std::fill(geometry.verticesViewed.begin(), geometry.verticesViewed.end(), GE_ViewedVertex());
+			geometry.vertexCacheTag = 1;
+		}
+		return geometry.vertexCacheTag;
+	}
+
+	template <typename AOFunc>
+	void TransformMeshToWorld(GE_FrameGeometry &geometry, const Mesh &mesh, const std::vector<Mesh_Side> &sides,
+		unsigned char visibleSides, const Matrix4 &matWorld, GE_Color color, AOFunc aoOf) {
+		std::vector<vec3> &verticesTransformed = geometry.verticesTransformed;
+		std::vector<unsigned int> &verticesTransformedTags = geometry.verticesTransformedTags;
+		const unsigned int vertexCacheTag = BeginVertexCache(geometry, mesh.vertices.size());
+
+		Triangle triTransformed;
+		triTransformed.color = color;
+		for (const Mesh_Side &side : sides) {
+			if ((visibleSides & SideBit(side.type)) == 0) {
+				continue;
+			}
+			for (int n = side.first; n < side.first + side.count; n++) {
+				const Triangle_Indexed &tri = mesh.polygons[n];
+				for (int i = 0; i < 3; i++) {
+					unsigned short v = tri.v[i];
+					if (verticesTransformedTags[v] != vertexCacheTag) {
+						verticesTransformedTags[v] = vertexCacheTag;
+						verticesTransformed[v] = Matrix4_MultiplyVectorAffine(mesh.vertices[v], matWorld);
 					}
+					triTransformed.p[i] = verticesTransformed[v];
+					triTransformed.ao[i] = aoOf(n, i);
 				}
+				geometry.trianglesTransformed.push_back(triTransformed);
 			}
+		}
+	}
 
-			if (tr.p[1].y == tr.p[2].y) {
-				DrawBottomFlatTriangle(renderer, tr.p);
-			} else
-				if (tr.p[0].y == tr.p[1].y) {
-					DrawTopFlatTriangle(renderer, tr.p);
-				} else {
-					SDL_Point splitPoint;
-					splitPoint.x = tr.p[0].x + ((float)(tr.p[1].y - tr.p[0].y) / (float)(tr.p[2].y - tr.p[0].y)) * (tr.p[2].x - tr.p[0].x);
-					splitPoint.y = tr.p[1].y;
-					SDL_Point points[3];
-					points[0] = tr.p[0];
-					points[1] = tr.p[1];
-					points[2] = splitPoint;
-					DrawBottomFlatTriangle(renderer, points);
-					points[0] = tr.p[1];
-					points[1] = splitPoint;
-					points[2] = tr.p[2];
-					DrawTopFlatTriangle(renderer, points);
+	void TransformObjectToWorld(GE_FrameGeometry &geometry, GE_Object &obj, const Matrix4 &matWorld) {
+		TransformMeshToWorld(geometry, obj.mesh, obj.sides, obj.getVisibleSides(), matWorld, obj.getColor(),
+			[&](int n, int i) { return obj.mesh.polygons[n].ao[i]; });
+	}
+
+	// Places the region mesh in the world, its blocks are relative to the region origin
+	static Matrix4 RegionMatrix(const Matrix4 &matWorld, const GE_RegionMesh &mesh) {
+		return PlaceInWorld(matWorld, { (float)mesh.originX, (float)mesh.originY, (float)mesh.originZ });
+	}
+
+	// Only the given sides, visible ones the camera may face. Corners are shared by the sides of the block
+	void TransformBlockToWorld(GE_FrameGeometry &geometry, const GE_MeshBlock &block, unsigned char sides, const Matrix4 &matRegion) {
+		if (sides == 0) {
+			return;
+		}
+		const GE_Object &cube = GE_STD_OBJECTS.CUBE;
+		std::vector<vec3> &verticesTransformed = geometry.verticesTransformed;
+		std::vector<unsigned int> &verticesTransformedTags = geometry.verticesTransformedTags;
+		const unsigned int vertexCacheTag = BeginVertexCache(geometry, cube.mesh.vertices.size());
+		const Matrix4 matBlock = PlaceInWorld(matRegion, block.getLocalPosition());
+		const unsigned long long aoLevels = block.aoLevels();
+
+		GE_Quad quad;
+		quad.color = GE_COLORS.getColorByType((Colors::Types)block.colorType);
+		for (const Mesh_Side &side : cube.sides) {
+			if ((sides & SideBit(side.type)) == 0) {
+				continue;
+			}
+			const int sideIndex = SideIndex(side.type);
+			for (int c = 0; c < 4; c++) {
+				unsigned short v = cubeSideCorners[sideIndex][c];
+				if (verticesTransformedTags[v] != vertexCacheTag) {
+					verticesTransformedTags[v] = vertexCacheTag;
+					verticesTransformed[v] = Matrix4_MultiplyVectorAffine(cube.mesh.vertices[v], matBlock);
 				}
+				quad.p[c] = verticesTransformed[v];
+				quad.ao[c] = AO_LEVELS[(aoLevels >> (2 * (4 * sideIndex + c))) & 3];
 			}
-		
+			quad.side = (unsigned char)sideIndex;
+			geometry.quadsTransformed.push_back(quad);
+		}
 	}
 
-	void FillTrianglesToRasterVector(std::vector<Triangle> &vecTrianglesToRaster, Triangle &tri, Matrix4 &matWorld, Matrix4 &matView) {
-		Triangle triProjected, triTransformed, triViewed;
+	// All placed copies share one cache, each from its own first entry, so it stays valid until the near clip
+	void TransformImportedMeshesToWorld(GE_FrameGeometry &geometry, const Matrix4 &matWorld) {
+		size_t vertexCount = 0;
+		for (const GE_MeshInstance &instance : geometry.input.meshInstances) {
+			vertexCount += instance.mesh->vertices.size();
+		}
+		BeginVertexCache(geometry, vertexCount);
+		unsigned int cacheFirst = 0;
+		for (const GE_MeshInstance &instance : geometry.input.meshInstances) {
+			TransformImportedMeshToWorld(geometry, instance, matWorld, cacheFirst);
+			cacheFirst += (unsigned int)instance.mesh->vertices.size();
+		}
+	}
 
-		// World Matrix Transform
-		triTransformed.p[0] = Matrix4_MultiplyVector(tri.p[0], matWorld);
-		triTransformed.p[1] = Matrix4_MultiplyVector(tri.p[1], matWorld);
-		triTransformed.p[2] = Matrix4_MultiplyVector(tri.p[2], matWorld);
-		/*triTransformed.R = tri.R;
-		triTransformed.G = tri.G;
-		triTransformed.B = tri.B;*/
-		triTransformed.color = tri.color;
+	// Only triangles of BVH leaves touching the view frustum are transformed, the rest is skipped node by node
+	void TransformImportedMeshToWorld(GE_FrameGeometry &geometry, const GE_MeshInstance &instance, const Matrix4 &matWorld, unsigned int cacheFirst) {
+		const GE_ImportedMesh &mesh = *instance.mesh;
+		const GE_FrameInput &input = geometry.input;
+		Matrix4 matInstance = PlaceInWorld(matWorld, instance.position);
+		GE_Frustum frustum = GE_Frustum_FromMatrix(Matrix4_MultiplyMatrix(Matrix4_MultiplyMatrix(matInstance, input.matView), input.matProj));
+
+		std::vector<vec3> &verticesTransformed = geometry.verticesTransformed;
+		std::vector<unsigned int> &verticesTransformedTags = geometry.verticesTransformedTags;
+		const unsigned int vertexCacheTag = geometry.vertexCacheTag;
+
+		size_t submittedBefore = geometry.cachedTransformed.size();
+		GE_CachedTriangle cached;
+		cached.color = GE_COLORS.getColorByType((Colors::Types)instance.colorType);
+		mesh.bvh.forEachVisibleLeaf(frustum, [&](unsigned int first, unsigned int count) {
+			for (unsigned int n = first; n < first + count; n++) {
+				const unsigned int *tri = &mesh.indices[3 * mesh.bvh.triangleOrder[n]];
+				for (int i = 0; i < 3; i++) {
+					unsigned int v = cacheFirst + tri[i];
+					if (verticesTransformedTags[v] != vertexCacheTag) {
+						verticesTransformedTags[v] = vertexCacheTag;
+						verticesTransformed[v] = Matrix4_MultiplyVectorAffine(mesh.vertices[tri[i]], matInstance);
+					}
+					cached.v[i] = v;
+				}
+				geometry.cachedTransformed.push_back(cached);
+			}
+		});
+		geometry.stats.trianglesSkipped += mesh.indices.size() / 3 - (geometry.cachedTransformed.size() - submittedBefore);
+	}
 
+	// Outlines are drawn in one colour, so without Light only the facing test is done
+	template <bool Light>
+	bool CullAndLightTriangle(Triangle &triTransformed, const vec3 &cameraPosition, const vec3 &lightDirection) {
 		// Calculate triangle Normal
 		vec3 normal, line1, line2;
 
@@ -509,672 +1180,3831 @@ private:
 		// Take cross product of lines to get normal to triangle surface
 		normal = Vector3_CrossProduct(line1, line2);
 
-		// You normally need to normalise a normal!
-		normal = Vector3_Normalize(normal);
-
 		// Get Ray from triangle to camera
-		vec3 vCameraRay = Vector3_Sub(triTransformed.p[0], MainCamera.position);
+		vec3 vCameraRay = Vector3_Sub(triTransformed.p[0], cameraPosition);
 
-		if (Vector3_DotProduct(normal, vCameraRay) < 0.0f) {
-
-			// How similar is normal to light direction
-			float dp = normal.x * LightDirection.x + normal.y * LightDirection.y + normal.z * LightDirection.z;
-			if (dp < 0.1f) {
-				dp = 0.1f;
-			}
-			triTransformed.color.R = dp * triTransformed.color.R;
-			triTransformed.color.G = dp * triTransformed.color.G;
-			triTransformed.color.B = dp * triTransformed.color.B;
-
-			// Convert World Space --> View Space
-			triViewed.p[0] = Matrix4_MultiplyVector(triTransformed.p[0], matView);
-			triViewed.p[1] = Matrix4_MultiplyVector(triTransformed.p[1], matView);
-			triViewed.p[2] = Matrix4_MultiplyVector(triTransformed.p[2], matView);
-			/*triViewed.R = triTransformed.R;
-			triViewed.G = triTransformed.G;
-			triViewed.B = triTransformed.B;*/
-			triViewed.color = triTransformed.color;
+		if (Vector3_DotProduct(normal, vCameraRay) >= 0.0f) {
+			return false;
+		}
+		if (!Light) {
+			return true;
+		}
 
-			int nClippedTriangles = 0;
-			Triangle clipped[2];
-			nClippedTriangles = Triangle_ClipAgainstPlane({ 0.0f, 0.0f, 0.1f }, { 0.0f, 0.0f, 1.0f }, triViewed, clipped[0], clipped[1]);
+		// You normally need to normalise a normal! Facing test above only needs the sign
+		normal = Vector3_Normalize(normal);
 
-			for (int n = 0; n < nClippedTriangles; n++)
-			{
-				// Project triangles from 3D --> 2D
-				triProjected.p[0] = Matrix4_MultiplyVector(clipped[n].p[0], matProj);
-				triProjected.p[1] = Matrix4_MultiplyVector(clipped[n].p[1], matProj);
-				triProjected.p[2] = Matrix4_MultiplyVector(clipped[n].p[2], matProj);
-				/*triProjected.R = clipped[n].R;
-				triProjected.G = clipped[n].G;
-				triProjected.B = clipped[n].B;*/
-				triProjected.color = clipped[n].color;
-
-				// X/Y are inverted so put them back
-				triProjected.p[0].x *= -1.0f;
-				triProjected.p[1].x *= -1.0f;
-				triProjected.p[2].x *= -1.0f;
-				triProjected.p[0].y *= -1.0f;
-				triProjected.p[1].y *= -1.0f;
-				triProjected.p[2].y *= -1.0f;
-
-				// Offset verts into visible normalised space
-				vec3 vOffsetView = { 1,1,0 };
-				triProjected.p[0] = Vector3_Add(triProjected.p[0], vOffsetView);
-				triProjected.p[1] = Vector3_Add(triProjected.p[1], vOffsetView);
-				triProjected.p[2] = Vector3_Add(triProjected.p[2], vOffsetView);
-				triProjected.p[0].x *= 0.5f * WIDTH;
-				triProjected.p[0].y *= 0.5f * HEIGHT;
-				triProjected.p[1].x *= 0.5f * WIDTH;
-				triProjected.p[1].y *= 0.5f * HEIGHT;
-				triProjected.p[2].x *= 0.5f * WIDTH;
-				triProjected.p[2].y *= 0.5f * HEIGHT;
-
-				// Store triangle for sorting
-				vecTrianglesToRaster.push_back(triProjected);
-			}
+		// How similar is normal to light direction
+		float dp = normal.x * lightDirection.x + normal.y * lightDirection.y + normal.z * lightDirection.z;
+		if (dp < 0.1f) {
+			dp = 0.1f;
 		}
+		triTransformed.color.R = dp * triTransformed.color.R;
+		triTransformed.color.G = dp * triTransformed.color.G;
+		triTransformed.color.B = dp * triTransformed.color.B;
+		return true;
 	}
-	
-	void DrawSceneObjects(SDL_Renderer *renderer) {
-		Matrix4 matRotX, matRotY, matRotZ;
 
-		/*static float theta = 0;
-		theta += 1.0f / 30.0f;*/
+	// One test and one shade for both triangles of a side. Sides are flat and their template normal is exact,
+	// so this decides and shades like CullAndLightTriangle on either triangle
+	template <bool Light>
+	bool CullAndLightQuad(GE_Quad &quad, const vec3 &cameraPosition, const float sideShades[6]) {
+		if (Vector3_DotProduct(cubeSideNormals[quad.side], Vector3_Sub(quad.p[0], cameraPosition)) >= 0.0f) {
+			return false;
+		}
+		if (Light) {
+			float dp = sideShades[quad.side];
+			quad.color.R = dp * quad.color.R;
+			quad.color.G = dp * quad.color.G;
+			quad.color.B = dp * quad.color.B;
+		}
+		return true;
+	}
 
-		// Rotation X
-		matRotX = Matrix4_MakeRotationX(0);
+	// Light factor of every side, as CullAndLightTriangle computes it
+	void ComputeSideShades(const vec3 &lightDirection, float sideShades[6]) {
+		for (int sideIndex = 0; sideIndex < 6; sideIndex++) {
+			vec3 normal = Vector3_Normalize(cubeSideNormals[sideIndex]);
+			float dp = normal.x * lightDirection.x + normal.y * lightDirection.y + normal.z * lightDirection.z;
+			sideShades[sideIndex] = dp < 0.1f ? 0.1f : dp;
+		}
+	}
 
-		// Rotation Y
-		matRotY = Matrix4_MakeRotationY(0);
+	// View space --> screen space
+	static vec3 ProjectToScreen(const GE_FrameInput &input, const vec3 &viewed) {
+		vec3 projected = Matrix4_MultiplyVector(viewed, input.matProj);
 
-		// Rotation Z
-		matRotZ = Matrix4_MakeRotationZ(0);
+		// X/Y are inverted so put them back
+		projected.x *= -1.0f;
+		projected.y *= -1.0f;
 
-		Matrix4 matTrans;
-		matTrans = Matrix4_MakeTranslation(0.0f, 0.0f, 5.0f);
+		// Offset verts into visible normalised space
+		vec3 vOffsetView = { 1,1,0 };
+		projected = Vector3_Add(projected, vOffsetView);
+		projected.x *= 0.5f * input.width;
+		projected.y *= 0.5f * input.height;
+		return projected;
+	}
 
-		Matrix4 matWorld;
-		matWorld = Matrix4_MakeIdentity();	// Form World Matrix
-		matWorld = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matWorld = Matrix4_MultiplyMatrix(matWorld, matRotZ); // Transform by rotation by Y
-		matWorld = Matrix4_MultiplyMatrix(matWorld, matTrans); // Transform by translation
+	// Corners are viewed and projected once, a side crossing the near plane is clipped as one polygon.
+	// The side gets one key: its grid distance in grid order, the mean depth of its corners otherwise
+	void FillQuadToRasterVector(GE_FrameGeometry &geometry, const GE_Quad &quad, float distance) {
+		const GE_FrameInput &input = geometry.input;
+		vec3 viewed[4];
+		for (int c = 0; c < 4; c++) {
+			viewed[c] = Matrix4_MultiplyVectorAffine(quad.p[c], input.matView);
+		}
 
-		vec3 upVector = { 0, 1, 0 };
-		vec3 targetVector = { 0, 0, 1 };
-        Matrix4 m1 = Matrix4_MakeRotationX(MainCamera.fXRotation);
-        Matrix4 m2 = Matrix4_MakeRotationY(MainCamera.fYRotation);
-		Matrix4 matCameraRot = Matrix4_MultiplyMatrix(m1, m2);
-		MainCamera.lookDirection = Matrix4_MultiplyVector(targetVector, matCameraRot);
-		targetVector = Vector3_Add(MainCamera.position, MainCamera.lookDirection);
-		Matrix4 matCamera = Matrix4_PointAt(MainCamera.position, targetVector, upVector);
+		// Near plane of FillViewedTriangleToRasterVector, a side in front of it keeps its four corners
+		GE_SidePolygon polygon;
+		polygon.color = quad.color;
+		polygon.count = 0;
+		const unsigned char *cycle = cubeSideCycle[quad.side];
+		for (int c = 0; c < 4; c++) {
+			int a = cycle[c], b = cycle[(c + 1) % 4];
+			float da = viewed[a].z - 0.1f, db = viewed[b].z - 0.1f;
+			if (da >= 0.0f) {
+				polygon.p[polygon.count] = viewed[a];
+				polygon.ao[polygon.count++] = quad.ao[a];
+			}
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				float t = da / (da - db);
+				polygon.p[polygon.count] = Vector3_Add(viewed[a], Vector3_Mul(Vector3_Sub(viewed[b], viewed[a]), t));
+				polygon.ao[polygon.count++] = quad.ao[a] + t * (quad.ao[b] - quad.ao[a]);
+			}
+		}
+		if (polygon.count < 3) {
+			geometry.stats.trianglesClipped += 2;
+			return;
+		}
 
-		Matrix4 matView = Matrix4_QuickInverse(matCamera);
+		float depth = 0.0f;
+		for (int c = 0; c < polygon.count; c++) {
+			polygon.p[c] = ProjectToScreen(input, polygon.p[c]);
+			depth += polygon.p[c].z;
+		}
+		depth /= polygon.count;
+		geometry.rasterOrder.push_back({ input.gridOrder ? distance : depth, (unsigned int)geometry.polygonsToRaster.size(), true });
+		geometry.polygonsToRaster.push_back(polygon);
+	}
 
-		// Store triagles for rastering later
-		std::vector<Triangle> vecTrianglesToRaster;
+	void FillTrianglesToRasterVector(GE_FrameGeometry &geometry, const Triangle &triTransformed) {
+		const GE_FrameInput &input = geometry.input;
+		Triangle triViewed;
+
+		// Convert World Space --> View Space
+		triViewed.p[0] = Matrix4_MultiplyVectorAffine(triTransformed.p[0], input.matView);
+		triViewed.p[1] = Matrix4_MultiplyVectorAffine(triTransformed.p[1], input.matView);
+		triViewed.p[2] = Matrix4_MultiplyVectorAffine(triTransformed.p[2], input.matView);
+		triViewed.color = triTransformed.color;
+		std::copy(triTransformed.ao, triTransformed.ao + 3, triViewed.ao);
+		FillViewedTriangleToRasterVector(geometry, triViewed);
+	}
 
-		for (GE_Object &obj : GE_DRAW_LIST.obj) {
-			//if (!Vector3_Equals(obj.getPosition(), GE_DRAW_LIST.selectorBox.getPosition())) {
-				for (Mesh_Side &side : obj.sides) {
-					if (!side.hidden) {
-						for (Triangle &tri : side.mesh.polygons) {
-							FillTrianglesToRasterVector(vecTrianglesToRaster, tri, matWorld, matView);
-						}
-					}
-				}
-			//}
+	// Imported triangles view their corners through the post-transform cache, and project them through it
+	// when the triangle needs no near clipping, so shared vertices are viewed and projected once
+	void FillCachedTriangleToRasterVector(GE_FrameGeometry &geometry, const GE_CachedTriangle &cached) {
+		const GE_FrameInput &input = geometry.input;
+		const unsigned int vertexCacheTag = geometry.vertexCacheTag;
+		Triangle tri;
+		tri.color = cached.color;
+		bool inFront = true;
+		for (int i = 0; i < 3; i++) {
+			unsigned int v = cached.v[i];
+			GE_ViewedVertex &vertex = geometry.verticesViewed[v];
+			if (vertex.viewedTag != vertexCacheTag) {
+				vertex.viewedTag = vertexCacheTag;
+				vertex.viewed = Matrix4_MultiplyVectorAffine(geometry.verticesTransformed[v], input.matView);
+			}
+			tri.p[i] = vertex.viewed;
+			inFront = inFront && tri.p[i].z >= 0.1f; // Inside of the near plane of FillViewedTriangleToRasterVector
 		}
-
-		for (Mesh_Side &side : GE_DRAW_LIST.selectorBox.sides) {
-			if (!side.hidden) {
-				for (Triangle &tri : side.mesh.polygons) {
-					FillTrianglesToRasterVector(vecTrianglesToRaster, tri, matWorld, matView);
-				}
+		if (!inFront) {
+			FillViewedTriangleToRasterVector(geometry, tri);
+			return;
+		}
+		for (int i = 0; i < 3; i++) {
+			GE_ViewedVertex &vertex = geometry.verticesViewed[cached.v[i]];
+			if (vertex.projectedTag != vertexCacheTag) {
+				vertex.projectedTag = vertexCacheTag;
+				vertex.projected = ProjectToScreen(input, vertex.viewed);
 			}
+			tri.p[i] = vertex.projected;
 		}
+		geometry.trianglesToRaster.push_back(tri);
+	}
 
-		sort(vecTrianglesToRaster.begin(), vecTrianglesToRaster.end(), [](Triangle &t1, Triangle &t2)
-			{
-				float z1 = (t1.p[0].z + t1.p[1].z + t1.p[2].z) / 3.0f;
-				float z2 = (t2.p[0].z + t2.p[1].z + t2.p[2].z) / 3.0f;
-				return z1 > z2;
-			});
+	// View Space --> near clip --> Screen Space
+	void FillViewedTriangleToRasterVector(GE_FrameGeometry &geometry, Triangle &triViewed) {
+		const GE_FrameInput &input = geometry.input;
+		Triangle triProjected;
+
+		int nClippedTriangles = 0;
+		Triangle clipped[2];
+		nClippedTriangles = Triangle_ClipAgainstPlane({ 0.0f, 0.0f, 0.1f }, { 0.0f, 0.0f, 1.0f }, triViewed, clipped[0], clipped[1]);
+		if (nClippedTriangles == 0) {
+			geometry.stats.trianglesClipped++;
+		}
 
-		for (Triangle &triToRaster : vecTrianglesToRaster)
+		for (int n = 0; n < nClippedTriangles; n++)
 		{
-			// Clip triangles against all four screen edges, this could yield
-			// a bunch of triangles, so create a queue that we traverse to 
-			//  ensure we only test new triangles generated against planes
-			Triangle clipped[2];
-			std::list<Triangle> listTriangles;
+			// Project triangles from 3D --> 2D
+			for (int i = 0; i < 3; i++) {
+				triProjected.p[i] = ProjectToScreen(input, clipped[n].p[i]);
+			}
+			triProjected.color = clipped[n].color;
+			std::copy(clipped[n].ao, clipped[n].ao + 3, triProjected.ao);
 
-			// Add initial triangle
-			listTriangles.push_back(triToRaster);
-			unsigned long nNewTriangles = 1;
+			// Store triangle for sorting
+			geometry.trianglesToRaster.push_back(triProjected);
+		}
+	}
 
-			for (int p = 0; p < 4; p++)
-			{
-				int nTrisToAdd = 0;
-				while (nNewTriangles > 0)
-				{
-					// Take triangle from front of queue
-					Triangle test = listTriangles.front();
-					listTriangles.pop_front();
-					nNewTriangles--;
-
-					// Clip it against a plane. We only need to test each 
-					// subsequent plane, against subsequent new triangles
-					// as all triangles after a plane clip are guaranteed
-					// to lie on the inside of the plane. I like how this
-					// comment is almost completely and utterly justified
-					switch (p)
-					{
-					case 0:	nTrisToAdd = Triangle_ClipAgainstPlane({ 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, test, clipped[0], clipped[1]); break;
-					case 1:	nTrisToAdd = Triangle_ClipAgainstPlane({ 0.0f, (float)HEIGHT - 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, test, clipped[0], clipped[1]); break;
-					case 2:	nTrisToAdd = Triangle_ClipAgainstPlane({ 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, test, clipped[0], clipped[1]); break;
-					case 3:	nTrisToAdd = Triangle_ClipAgainstPlane({ (float)WIDTH - 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, test, clipped[0], clipped[1]); break;
-					}
+	// Painter's order key, bigger is further away
+	static float TriangleDepth(const Triangle &t) {
+		return (t.p[0].z + t.p[1].z + t.p[2].z) / 3.0f;
+	}
 
-					// Clipping may yield a variable number of triangles, so
-					// add these new ones to the back of the queue for subsequent
-					// clipping against next planes
-					for (int w = 0; w < nTrisToAdd; w++) {
-						listTriangles.push_back(clipped[w]);
-					}
+	// Convex polygons on screen as a whole are kept, others are clipped against the four screen edges, at
+	// most one corner more per edge. Counts go in triangles, a polygon of n corners standing for n - 2
+	void ClipPolygonAgainstScreen(GE_FrameGeometry &geometry, const vec3 *p, const float *ao, int count, const GE_Color &color, float depth,
+		std::vector<GE_ScreenPolygon> &clippedOut, std::vector<float> &depthsOut) {
+		const float maxX = (float)geometry.input.width - 1.0f, maxY = (float)geometry.input.height - 1.0f;
+		int inside = 0, left = 0, right = 0, above = 0, below = 0;
+		for (int c = 0; c < count; c++) {
+			left += p[c].x < 0.0f;
+			right += p[c].x > maxX;
+			above += p[c].y < 0.0f;
+			below += p[c].y > maxY;
+			inside += p[c].x >= 0.0f && p[c].x <= maxX && p[c].y >= 0.0f && p[c].y <= maxY;
+		}
+		if (left == count || right == count || above == count || below == count) {
+			geometry.stats.trianglesClipped += count - 2;
+			return;
+		}
 
+		GE_ScreenPolygon polygons[2];
+		GE_ScreenPolygon *from = &polygons[0], *to = &polygons[1];
+		std::copy(p, p + count, from->p);
+		std::copy(ao, ao + count, from->ao);
+		from->count = (unsigned char)count;
+		for (int edge = 0; edge < 4 && inside < count && from->count > 0; edge++) {
+			// Signed distance inside of the edge: top, bottom, left, right
+			auto distance = [&](const vec3 &v) {
+				switch (edge) {
+				case 0: return v.y;
+				case 1: return maxY - v.y;
+				case 2: return v.x;
+				default: return maxX - v.x;
+				}
+			};
+			to->count = 0;
+			for (int c = 0; c < from->count; c++) {
+				int n = (c + 1) % from->count;
+				float da = distance(from->p[c]), db = distance(from->p[n]);
+				if (da >= 0.0f) {
+					to->p[to->count] = from->p[c];
+					to->ao[to->count++] = from->ao[c];
+				}
+				if ((da >= 0.0f) != (db >= 0.0f)) {
+					float t = da / (da - db);
+					to->p[to->count] = Vector3_Add(from->p[c], Vector3_Mul(Vector3_Sub(from->p[n], from->p[c]), t));
+					to->ao[to->count++] = from->ao[c] + t * (from->ao[n] - from->ao[c]);
 				}
-				nNewTriangles = listTriangles.size();
 			}
+			std::swap(from, to);
+		}
 
+		if (from->count < 3) {
+			geometry.stats.trianglesClipped += count - 2;
+			return;
+		}
+		from->color = color;
+		clippedOut.push_back(*from);
+		depthsOut.push_back(depth);
+	}
 
-			// Draw the transformed, viewed, clipped, projected, sorted, clipped triangles
-			for (Triangle &t : listTriangles)
-			{
-				SDL_Point points[3] = {
-							{ (int)t.p[0].x,(int)t.p[0].y },
-							{ (int)t.p[1].x,(int)t.p[1].y },
-							{ (int)t.p[2].x,(int)t.p[2].y }
-				};
-				Triangle2D tr = { points[0], points[1], points[2] };
-				switch (GE_RENDERING_STYLE)
-				{
-				case Engine3D::RENDERING_STYLES::STD_SHADED:
-					SDL_SetRenderDrawColor(renderer, t.color.R, t.color.G, t.color.B, 255.0f);
-					DrawFilledTriangle2D(renderer, tr);
-					break;
-				case Engine3D::RENDERING_STYLES::STD_POLY_SHADED:
-					SDL_SetRenderDrawColor(renderer, t.color.R, t.color.G, t.color.B, 255.0f);
-					DrawFilledTriangle2D(renderer, tr);
-					SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-					DrawTriangle2D(renderer, tr);
-					break;
-				case Engine3D::RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS:
-					SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-					DrawTriangle2D(renderer, tr);
-					break;
-				default:
-					break;
-				}
+	template <RENDERING_STYLES Style>
+	void RasterPolygon(SDL_Renderer *renderer, const GE_ScreenPolygon &polygon) {
+		// Draw the transformed, viewed, clipped, projected, sorted, clipped polygons
+		if (GE_StyleTraits<Style>::FILL) {
+			DrawFilledPolygon2D(renderer, polygon);
+		}
+		if (GE_StyleTraits<Style>::OUTLINE) {
+			if (GE_StyleTraits<Style>::FILL) {
+				SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
 			}
+			DrawPolygonOutline2D(renderer, polygon);
 		}
+	}
 
+	// Polygons stand for n - 2 triangles in the counters, so they compare with frames drawn as triangles
+	static unsigned int PolygonTriangles(const GE_ScreenPolygon &polygon) {
+		return polygon.count - 2;
 	}
 
-	void resetMainCamera() {
-		MainCamera.position = { 3, 4, 0 };
-		MainCamera.lookDirection = { 0, 0, 1 };
-		MainCamera.fXRotation = M_PI / 6.0f; //3.14159f / 1000.0f;
-		MainCamera.fYRotation = M_PI / 8.0f; // 3.14159f / 4.0f;
-		MainCamera.fFOV = 90.0f;
-		MainCamera.fNear = 0.1f;
-		MainCamera.fFar = 1000.0f;
+	// Used corners only, the rest of the arrays is left over from clipping
+	static bool IsSamePolygon(const GE_ScreenPolygon &a, const GE_ScreenPolygon &b) {
+		return a.count == b.count && memcmp(&a.color, &b.color, sizeof(GE_Color)) == 0 &&
+			memcmp(a.p, b.p, a.count * sizeof(vec3)) == 0 && memcmp(a.ao, b.ao, a.count * sizeof(float)) == 0;
 	}
 
-	GE_Object* getGEObjectPointerByPos(vec3 pos) {
-		for (GE_Object &obj : GE_DRAW_LIST.obj) {
-            vec3 objPos = obj.getPosition();
-			if (Vector3_Equals(objPos, pos)) {
-				return &obj;
-			}
+	// Takes a snapshot of the camera and the scene for the geometry stage, runs on the main thread
+	void PrepareFrameInput(GE_FrameInput &input) {
+		const GE_Camera &camera = RenderCamera();
+		vec3 upVector = { 0, 1, 0 };
+		vec3 lookDirection = CameraLookDirection(camera);
+		if (sceneSnapshot == nullptr) {
+			MainCamera.lookDirection = lookDirection; // Picking meshes in view reads it
+		}
+		vec3 targetVector = Vector3_Add(camera.position, lookDirection);
+		Matrix4 matCamera = Matrix4_PointAt(camera.position, targetVector, upVector);
+
+		input.matView = Matrix4_QuickInverse(matCamera);
+		input.matProj = matProj;
+		input.cameraPosition = camera.position;
+		input.lightDirection = LightDirection;
+		input.width = WIDTH;
+		input.height = HEIGHT;
+		input.style = GE_RENDERING_STYLE;
+
+		if (sceneSnapshot != nullptr) {
+			input.selectorBox = sceneSnapshot->selectorBox;
+			input.regionMeshes = sceneSnapshot->regionMeshes;
+			input.meshInstances = sceneSnapshot->meshInstances;
+		} else {
+			input.selectorBox = GE_DRAW_LIST.selectorBox;
+			CollectRegionMeshes(input.regionMeshes);
+			input.meshInstances.assign(GE_DRAW_LIST.meshInstances.begin(), GE_DRAW_LIST.meshInstances.end());
 		}
-		return nullptr;
+		input.gridOrder = GE_OPTIONS.gridOrder && input.meshInstances.empty();
+		input.inputNs = GE_PROFILER.now();
+		input.keyNs = pendingKeyNs;
 	}
 
-	void ShowPreviouslyUnneededSidesByObj(GE_Object *obj) {
-		struct vec3_wd {
-			GE_MESH_SIDE_TYPE sideType = GE_MESH_SIDE_TYPE::UNDEFINED;
-			GE_MESH_SIDE_TYPE counterSideType = GE_MESH_SIDE_TYPE::UNDEFINED;
-			vec3 vec;
-		};
-		switch (obj->getObjType()) {
-		case GE_OBJECT_TYPE::CUBE: {
-			vec3 objPos = obj->getPosition();
-
-			std::vector<vec3_wd> neighbourPositions;
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::EAST,	GE_MESH_SIDE_TYPE::WEST,	 1,  0,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::TOP, GE_MESH_SIDE_TYPE::BOTTOM,	 0,  1,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::NORTH, GE_MESH_SIDE_TYPE::SOUTH,	 0,  0,  1 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::WEST, GE_MESH_SIDE_TYPE::EAST,	-1,  0,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::BOTTOM, GE_MESH_SIDE_TYPE::TOP,	 0, -1,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::SOUTH,GE_MESH_SIDE_TYPE::NORTH,	 0,  0, -1 });
-			for (vec3_wd &v_wd : neighbourPositions) {
-				v_wd.vec = Vector3_Add(v_wd.vec, objPos);
-				GE_Object *neighbourObj = getGEObjectPointerByPos(v_wd.vec);
-				if (neighbourObj != nullptr) {
-					switch (neighbourObj->getObjType()) {
-					case GE_OBJECT_TYPE::CUBE: {
-						neighbourObj->showSide(v_wd.counterSideType);
-						break;
-					}
-					default:
-						break;
-					}
-				}
+	// Region meshes are immutable, holding them keeps them alive even if the region is rebuilt meanwhile
+	void CollectRegionMeshes(std::vector<std::shared_ptr<const GE_RegionMesh>> &meshes) {
+		meshes.clear();
+		for (auto &entry : GE_DRAW_LIST.regions) {
+			if (entry.second.mesh != nullptr) {
+				meshes.push_back(entry.second.mesh);
 			}
+		}
+	}
 
+	// Transform, cull, clip and sort, reads nothing but the frame input and the shared cube template
+	void BuildFrameGeometry(GE_FrameGeometry &geometry) {
+		switch (geometry.input.style) {
+		case RENDERING_STYLES::STD_SHADED:
+			BuildFrameGeometry<RENDERING_STYLES::STD_SHADED>(geometry);
 			break;
-		}
-		default:
+		case RENDERING_STYLES::STD_POLY_SHADED:
+			BuildFrameGeometry<RENDERING_STYLES::STD_POLY_SHADED>(geometry);
+			break;
+		case RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS:
+			BuildFrameGeometry<RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS>(geometry);
 			break;
 		}
 	}
 
-	void HideUnneededSidesByObj(GE_Object *obj) {
-		struct vec3_wd {
-			GE_MESH_SIDE_TYPE sideType = GE_MESH_SIDE_TYPE::UNDEFINED;
-			GE_MESH_SIDE_TYPE counterSideType = GE_MESH_SIDE_TYPE::UNDEFINED;
-			vec3 vec;
-		};
-		switch (obj->getObjType()) {
-		case GE_OBJECT_TYPE::CUBE: {
-			vec3 objPos = obj->getPosition();
-
-			std::vector<vec3_wd> neighbourPositions;
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::EAST,	GE_MESH_SIDE_TYPE::WEST,	 1,  0,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::TOP, GE_MESH_SIDE_TYPE::BOTTOM,	 0,  1,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::NORTH, GE_MESH_SIDE_TYPE::SOUTH,	 0,  0,  1 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::WEST, GE_MESH_SIDE_TYPE::EAST,	-1,  0,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::BOTTOM, GE_MESH_SIDE_TYPE::TOP,	 0, -1,  0 });
-			neighbourPositions.push_back({ GE_MESH_SIDE_TYPE::SOUTH,GE_MESH_SIDE_TYPE::NORTH,	 0,  0, -1 });
-			for (vec3_wd &v_wd : neighbourPositions) {
-				v_wd.vec = Vector3_Add(v_wd.vec, objPos);
-				GE_Object *neighbourObj = getGEObjectPointerByPos(v_wd.vec);
-				if (neighbourObj != nullptr) {
-					switch (neighbourObj->getObjType()) {
-					case GE_OBJECT_TYPE::CUBE: {
-						neighbourObj->hideSide(v_wd.counterSideType);
-						obj->hideSide(v_wd.sideType);
-						break;
+	template <RENDERING_STYLES Style>
+	void BuildFrameGeometry(GE_FrameGeometry &geometry) {
+		const Matrix4 matWorld = WorldMatrix();
+		GE_FrameInput &input = geometry.input;
+		GE_FrameStats &stats = geometry.stats;
+		stats = GE_FrameStats();
+
+		geometry.cachedTransformed.clear();
+		geometry.cachedLit.clear();
+		geometry.quadsTransformed.clear();
+		geometry.quadsLit.clear();
+		geometry.polygonsToRaster.clear();
+		geometry.trianglesToRaster.clear();
+		geometry.rasterOrder.clear();
+		geometry.polygonsClipped.clear();
+		geometry.depthsClipped.clear();
+
+		geometry.distancesTransformed.clear();
+		geometry.distancesLit.clear();
+
+		// World matrix only translates, so the camera relative to the block grid is a subtraction
+		const vec3 eye = Vector3_Sub(input.cameraPosition, { matWorld.m[3][0], matWorld.m[3][1], matWorld.m[3][2] });
+		if (input.gridOrder) {
+			GE_ProfileScope scope(GE_PROFILER, "Grid order", &stats.stageMs[(int)PIPELINE_STAGES::SORT]);
+			OrderBlocksByCellDistance(geometry, eye);
+		}
+
+		{
+			GE_ProfileScope scope(GE_PROFILER, "Transform", &stats.stageMs[(int)PIPELINE_STAGES::TRANSFORM]);
+			if (input.gridOrder) {
+				for (const GE_OrderedBlock &ordered : geometry.blocksOrdered) {
+					TransformBlockToWorld(geometry, ordered.block, ordered.sides, geometry.regionMatrices[ordered.region]);
+					geometry.distancesTransformed.resize(geometry.quadsTransformed.size(), (float)ordered.distance);
+				}
+			} else {
+				ForEachFrontSideGroup(geometry, eye, [&](unsigned int /*region*/, const GE_RegionMesh &mesh, const GE_SideGroup &group, unsigned char sides) {
+					const Matrix4 matRegion = RegionMatrix(matWorld, mesh);
+					for (unsigned int i = group.first; i < group.first + group.count; i++) {
+						TransformBlockToWorld(geometry, mesh.visibleBlocks[i], sides, matRegion);
 					}
-					default:
-						break;
+				});
+			}
+			TransformImportedMeshesToWorld(geometry, matWorld);
+			stats.trianglesSubmitted = 2 * geometry.quadsTransformed.size() + geometry.cachedTransformed.size() + stats.trianglesGroupCulled;
+		}
+
+		{
+			GE_ProfileScope scope(GE_PROFILER, "Backface cull", &stats.stageMs[(int)PIPELINE_STAGES::BACKFACE_CULL]);
+			float sideShades[6];
+			ComputeSideShades(input.lightDirection, sideShades);
+			for (size_t i = 0; i < geometry.quadsTransformed.size(); i++) {
+				GE_Quad &quad = geometry.quadsTransformed[i];
+				if (CullAndLightQuad<GE_StyleTraits<Style>::FILL>(quad, input.cameraPosition, sideShades)) {
+					geometry.quadsLit.push_back(quad);
+					if (input.gridOrder) {
+						geometry.distancesLit.push_back(geometry.distancesTransformed[i]);
 					}
 				}
 			}
+			Triangle tri;
+			for (GE_CachedTriangle &cached : geometry.cachedTransformed) {
+				for (int i = 0; i < 3; i++) {
+					tri.p[i] = geometry.verticesTransformed[cached.v[i]];
+				}
+				tri.color = cached.color;
+				if (CullAndLightTriangle<GE_StyleTraits<Style>::FILL>(tri, input.cameraPosition, input.lightDirection)) {
+					cached.color = tri.color;
+					geometry.cachedLit.push_back(cached);
+				}
+			}
+			stats.trianglesCulled = 2 * (geometry.quadsTransformed.size() - geometry.quadsLit.size()) +
+				geometry.cachedTransformed.size() - geometry.cachedLit.size() + stats.trianglesGroupCulled;
+		}
+
+		{
+			// Grid order has no imported meshes, so only quads carry distances
+			GE_ProfileScope scope(GE_PROFILER, "Near clip", &stats.stageMs[(int)PIPELINE_STAGES::NEAR_CLIP]);
+			for (size_t i = 0; i < geometry.quadsLit.size(); i++) {
+				FillQuadToRasterVector(geometry, geometry.quadsLit[i], input.gridOrder ? geometry.distancesLit[i] : 0.0f);
+			}
+			for (const GE_CachedTriangle &cached : geometry.cachedLit) {
+				FillCachedTriangleToRasterVector(geometry, cached);
+			}
+			for (size_t i = 0; i < geometry.trianglesToRaster.size(); i++) {
+				geometry.rasterOrder.push_back({ TriangleDepth(geometry.trianglesToRaster[i]), (unsigned int)i, false });
+			}
+		}
+
+		// Outlines alone look the same in any order, grid order is painter's order already
+		if (GE_StyleTraits<Style>::FILL && !input.gridOrder) {
+			GE_ProfileScope scope(GE_PROFILER, "Sort", &stats.stageMs[(int)PIPELINE_STAGES::SORT]);
+			sort(geometry.rasterOrder.begin(), geometry.rasterOrder.end(), [](const GE_RasterKey &k1, const GE_RasterKey &k2)
+				{
+					return k1.depth > k2.depth;
+				});
+		}
+
+		{
+			GE_ProfileScope scope(GE_PROFILER, "Screen clip", &stats.stageMs[(int)PIPELINE_STAGES::SCREEN_CLIP]);
+			for (const GE_RasterKey &key : geometry.rasterOrder) {
+				if (key.polygon) {
+					const GE_SidePolygon &side = geometry.polygonsToRaster[key.index];
+					ClipPolygonAgainstScreen(geometry, side.p, side.ao, side.count, side.color, key.depth, geometry.polygonsClipped, geometry.depthsClipped);
+				} else {
+					const Triangle &tri = geometry.trianglesToRaster[key.index];
+					ClipPolygonAgainstScreen(geometry, tri.p, tri.ao, 3, tri.color, key.depth, geometry.polygonsClipped, geometry.depthsClipped);
+				}
+			}
+		}
 
+		BuildSelectorGeometry<Style>(geometry);
+	}
+
+	void BuildSelectorGeometry(GE_FrameGeometry &geometry) {
+		switch (geometry.input.style) {
+		case RENDERING_STYLES::STD_SHADED:
+			BuildSelectorGeometry<RENDERING_STYLES::STD_SHADED>(geometry);
+			break;
+		case RENDERING_STYLES::STD_POLY_SHADED:
+			BuildSelectorGeometry<RENDERING_STYLES::STD_POLY_SHADED>(geometry);
+			break;
+		case RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS:
+			BuildSelectorGeometry<RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS>(geometry);
 			break;
 		}
-		default:
+	}
+
+	// All stages for the selector alone, reuses the scratch vectors the world stages are done with
+	template <RENDERING_STYLES Style>
+	void BuildSelectorGeometry(GE_FrameGeometry &geometry) {
+		GE_FrameInput &input = geometry.input;
+		geometry.trianglesTransformed.clear();
+		geometry.trianglesToRaster.clear();
+		geometry.selectorClipped.clear();
+		geometry.selectorDepths.clear();
+
+		TransformObjectToWorld(geometry, input.selectorBox, WorldMatrix());
+		geometry.stats.trianglesSubmitted += geometry.trianglesTransformed.size();
+		for (Triangle &tri : geometry.trianglesTransformed) {
+			if (CullAndLightTriangle<GE_StyleTraits<Style>::FILL>(tri, input.cameraPosition, input.lightDirection)) {
+				FillTrianglesToRasterVector(geometry, tri);
+			} else {
+				geometry.stats.trianglesCulled++;
+			}
+		}
+		sort(geometry.trianglesToRaster.begin(), geometry.trianglesToRaster.end(), [](Triangle &t1, Triangle &t2)
+			{
+				return TriangleDepth(t1) > TriangleDepth(t2);
+			});
+		// In grid order the selector takes the distance of its cell, so it merges with the world like a block.
+		// Half a step nearer draws it after every block at that distance, the one in its own cell included
+		int eyeCell[3];
+		EyeCell(input, eyeCell);
+		vec3 selectorPosition = input.selectorBox.getPosition();
+		float selectorDistance = (float)CellDistance((int)lroundf(selectorPosition.x), (int)lroundf(selectorPosition.y), (int)lroundf(selectorPosition.z), eyeCell) - 0.5f;
+		for (Triangle &triToRaster : geometry.trianglesToRaster) {
+			float depth = input.gridOrder ? selectorDistance : TriangleDepth(triToRaster);
+			ClipPolygonAgainstScreen(geometry, triToRaster.p, triToRaster.ao, 3, triToRaster.color, depth, geometry.selectorClipped, geometry.selectorDepths);
+		}
+	}
+
+	void RasterFrameGeometry(SDL_Renderer *renderer, GE_FrameGeometry &geometry) {
+		switch (geometry.input.style) {
+		case RENDERING_STYLES::STD_SHADED:
+			RasterFrameGeometry<RENDERING_STYLES::STD_SHADED>(renderer, geometry);
+			break;
+		case RENDERING_STYLES::STD_POLY_SHADED:
+			RasterFrameGeometry<RENDERING_STYLES::STD_POLY_SHADED>(renderer, geometry);
+			break;
+		case RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS:
+			RasterFrameGeometry<RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS>(renderer, geometry);
 			break;
 		}
 	}
 
-	void CreateBlockAtSelectorPosition() {
-		vec3 pos = GE_DRAW_LIST.selectorBox.getPosition();
-		GE_Object *obj = getGEObjectPointerByPos(pos);
-		if (obj == nullptr){
-			GE_Object sBox = GE_STD_OBJECTS.CUBE;
-			sBox.moveTo(pos);
-			HideUnneededSidesByObj(&sBox);
-			GE_DRAW_LIST.obj.push_back(sBox);
-			printf("Created block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
-		} else {
-			printf("Aborted to created block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+	template <RENDERING_STYLES Style>
+	void RasterFrameGeometry(SDL_Renderer *renderer, GE_FrameGeometry &geometry) {
+		// Geometry stage results count towards the frame they are drawn in
+		const GE_FrameStats &stats = geometry.stats;
+		for (int i = (int)PIPELINE_STAGES::TRANSFORM; i <= (int)PIPELINE_STAGES::SCREEN_CLIP; i++) {
+			GE_FRAME_STATS.stageMs[i] = stats.stageMs[i];
 		}
+		GE_FRAME_STATS.trianglesSubmitted = stats.trianglesSubmitted;
+		GE_FRAME_STATS.trianglesCulled = stats.trianglesCulled;
+		GE_FRAME_STATS.trianglesGroupCulled = stats.trianglesGroupCulled;
+		GE_FRAME_STATS.trianglesClipped = stats.trianglesClipped;
+		GE_FRAME_STATS.trianglesSkipped = stats.trianglesSkipped;
+
+		GE_ProfileScope scope(GE_PROFILER, "Raster", &GE_FRAME_STATS.stageMs[(int)PIPELINE_STAGES::RASTER]);
+		GE_FRAME_STATS.trianglesDrawn = RasterLayers<Style>(renderer, geometry, nullptr);
 	}
 
-	void RemoveBlockAtSelectorPosition() {
-		// Can't use getGEObjectPointerByPos() because we need to remove from vector by index
-		vec3 pos = GE_DRAW_LIST.selectorBox.getPosition();
-		int index = -1;
-		int i = 0;
-		for (GE_Object &obj : GE_DRAW_LIST.obj) {
-            vec3 objPos = obj.getPosition();
-			if (Vector3_Equals(objPos, pos)) {
-				index = i;
+	size_t RasterLayers(SDL_Renderer *renderer, GE_FrameGeometry &geometry, const std::vector<unsigned int> *worldSubset) {
+		switch (geometry.input.style) {
+		case RENDERING_STYLES::STD_SHADED:
+			return RasterLayers<RENDERING_STYLES::STD_SHADED>(renderer, geometry, worldSubset);
+		case RENDERING_STYLES::STD_POLY_SHADED:
+			return RasterLayers<RENDERING_STYLES::STD_POLY_SHADED>(renderer, geometry, worldSubset);
+		case RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS:
+			return RasterLayers<RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS>(renderer, geometry, worldSubset);
+		}
+		return 0;
+	}
+
+	// Merges selector polygons into the world back to front, on equal depth the selector is drawn last so it stays visible
+	// on faces it touches. A subset lists the world polygons to draw in ascending order, returns the triangles drawn
+	template <RENDERING_STYLES Style>
+	size_t RasterLayers(SDL_Renderer *renderer, GE_FrameGeometry &geometry, const std::vector<unsigned int> *worldSubset) {
+		if (!GE_StyleTraits<Style>::FILL) {
+			SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255); // Outline colour never changes
+		}
+		// Outlines are lines drawn over the fill, only the fill alone can go front to back
+		if (!GE_StyleTraits<Style>::OUTLINE && GE_OPTIONS.spanBuffer) {
+			spanOrder.clear();
+			ForEachLayerPolygon(geometry, worldSubset, [&](const GE_ScreenPolygon &polygon) { spanOrder.push_back(&polygon); });
+			return RasterFrontToBack(renderer, geometry.input.width, geometry.input.height);
+		}
+		size_t drawn = 0;
+		ForEachLayerPolygon(geometry, worldSubset, [&](const GE_ScreenPolygon &polygon) {
+			RasterPolygon<Style>(renderer, polygon);
+			drawn += PolygonTriangles(polygon);
+		});
+		return drawn;
+	}
+
+	// Back to front
+	template <typename PolygonFunc>
+	void ForEachLayerPolygon(const GE_FrameGeometry &geometry, const std::vector<unsigned int> *worldSubset, PolygonFunc polygon) {
+		const std::vector<GE_ScreenPolygon> &world = geometry.polygonsClipped;
+		const std::vector<GE_ScreenPolygon> &selector = geometry.selectorClipped;
+		size_t worldCount = worldSubset != nullptr ? worldSubset->size() : world.size();
+		size_t s = 0;
+		for (size_t i = 0; i < worldCount; i++) {
+			size_t w = worldSubset != nullptr ? (*worldSubset)[i] : i;
+			while (s < selector.size() && geometry.selectorDepths[s] > geometry.depthsClipped[w]) {
+				polygon(selector[s++]);
+			}
+			polygon(world[w]);
+		}
+		while (s < selector.size()) {
+			polygon(selector[s++]);
+		}
+	}
+
+	static void PolygonBounds(const GE_ScreenPolygon &polygon, float &minX, float &minY, float &maxX, float &maxY) {
+		minX = maxX = polygon.p[0].x;
+		minY = maxY = polygon.p[0].y;
+		for (int c = 1; c < polygon.count; c++) {
+			minX = std::min(minX, polygon.p[c].x);
+			minY = std::min(minY, polygon.p[c].y);
+			maxX = std::max(maxX, polygon.p[c].x);
+			maxY = std::max(maxY, polygon.p[c].y);
+		}
+	}
+
+	// Reverse of the painter's order gives the same image, polygons whose rows are all covered are not drawn at all
+	size_t RasterFrontToBack(SDL_Renderer *renderer, int width, int height) {
+		spanBuffer.reset(width, height);
+		spanBufferActive = true;
+		size_t drawn = 0;
+		for (auto it = spanOrder.rbegin(); it != spanOrder.rend(); ++it) {
+			if (spanBuffer.isFull()) {
+				for (; it != spanOrder.rend(); ++it) {
+					GE_FRAME_STATS.trianglesOccluded += PolygonTriangles(**it);
+				}
 				break;
 			}
-			i++;
+			const GE_ScreenPolygon &polygon = **it;
+			float minX, minY, maxX, maxY;
+			PolygonBounds(polygon, minX, minY, maxX, maxY);
+			if (spanBuffer.areRowsFull((int)minY, (int)maxY)) {
+				GE_FRAME_STATS.trianglesOccluded += PolygonTriangles(polygon);
+				continue;
+			}
+			RasterPolygon<RENDERING_STYLES::STD_SHADED>(renderer, polygon);
+			drawn += PolygonTriangles(polygon);
 		}
-		if (index >= 0)	{
-			ShowPreviouslyUnneededSidesByObj(&(GE_DRAW_LIST.obj[index]));
-			GE_DRAW_LIST.obj.erase(GE_DRAW_LIST.obj.begin() + index);
-			printf("Removed block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
-		} else {
-			printf("Unable to remove block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+		spanBufferActive = false;
+		return drawn;
+	}
+
+	void DrawOverlayText(SDL_Renderer *renderer, int x, int y, int scale, const char *text) {
+		// 3x5 pixel font, 3 bits per row starting from the top row
+		static const unsigned short DIGITS[10] = { 0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF };
+		static const unsigned short LETTERS[26] = {
+			0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B, 0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED,
+			0x6B6D, 0x2B6A, 0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD, 0x5AAD, 0x5A92, 0x72A7
+		};
+		for (const char *c = text; *c != '\0'; c++) {
+			unsigned short glyph = 0;
+			if (*c >= '0' && *c <= '9') {
+				glyph = DIGITS[*c - '0'];
+			} else if (*c >= 'A' && *c <= 'Z') {
+				glyph = LETTERS[*c - 'A'];
+			} else if (*c >= 'a' && *c <= 'z') {
+				glyph = LETTERS[*c - 'a'];
+			} else {
+				switch (*c) {
+				case '.': glyph = 0x0002; break;
+				case ':': glyph = 0x0410; break;
+				case '-': glyph = 0x01C0; break;
+				case '/': glyph = 0x12A4; break;
+				case '%': glyph = 0x52A5; break;
+				default: break;
+				}
+			}
+			for (int row = 0; row < 5; row++) {
+				for (int col = 0; col < 3; col++) {
+					if (glyph & (1 << (14 - row * 3 - col))) {
+						SDL_Rect pixel = { x + col * scale, y + row * scale, scale, scale };
+						SDL_RenderFillRect(renderer, &pixel);
+					}
+				}
+			}
+			x += 4 * scale;
 		}
 	}
 
-	void ChangeBlockColorAtSelectorPosition() {
-		vec3 pos = GE_DRAW_LIST.selectorBox.getPosition();
-		GE_Object *obj = getGEObjectPointerByPos(pos);
-		if (obj != nullptr) {
-			Colors::Types newColorType = GE_COLORS.getColorTypeAfter(obj->getColorType());
-			GE_Color newColor = GE_COLORS.getColorByType(newColorType);
-			obj->setColor(newColor, newColorType);
-			printf("Changed block color at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+	void DrawProfilerOverlay(SDL_Renderer *renderer) {
+		const int scale = 2;
+		const int lineHeight = 6 * scale + 2;
+		const int stageCount = (int)PIPELINE_STAGES::COUNT;
+		GE_FrameStats &stats = GE_FRAME_STATS_SMOOTHED;
+		char line[64];
+
+		SDL_Rect background = { 4, 4, 300, lineHeight * (stageCount + 10) + 8 };
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+		SDL_RenderFillRect(renderer, &background);
+
+		int y = 8;
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		snprintf(line, sizeof(line), "FRAME %.2f MS", stats.frameMs);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "LATENCY %.2f MS", stats.latencyMs);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "INPUT %.2f / %.2f MS APPLIED", stats.inputLatencyMs, stats.inputApplyMs);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "SCALE %.2f %dX%d", renderScale, WIDTH, HEIGHT);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight * 2;
+
+		for (int i = 0; i < stageCount; i++) {
+			SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+			snprintf(line, sizeof(line), "%s %.2f", PIPELINE_STAGE_NAMES[i], stats.stageMs[i]);
+			DrawOverlayText(renderer, 8, y, scale, line);
+
+			// Bar is 20px per millisecond
+			SDL_Rect bar = { 180, y, std::min(116, (int)(stats.stageMs[i] * 20.0)), 5 * scale };
+			SDL_SetRenderDrawColor(renderer, 250, 211, 0, 255);
+			SDL_RenderFillRect(renderer, &bar);
+			y += lineHeight;
 		}
-		else {
-			printf("Aborted to change block color at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+		y += lineHeight;
+
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		snprintf(line, sizeof(line), "SUBMITTED %lu", GE_FRAME_STATS.trianglesSubmitted);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "CULLED %lu / %lu GROUPED", GE_FRAME_STATS.trianglesCulled, GE_FRAME_STATS.trianglesGroupCulled);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "SKIPPED %lu", GE_FRAME_STATS.trianglesSkipped);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		if (GE_OPTIONS.spanBuffer) {
+			snprintf(line, sizeof(line), "OCCLUDED %lu", GE_FRAME_STATS.trianglesOccluded);
+			DrawOverlayText(renderer, 8, y, scale, line);
+			y += lineHeight;
 		}
+		snprintf(line, sizeof(line), "CLIPPED %lu", GE_FRAME_STATS.trianglesClipped);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "DRAWN %lu", GE_FRAME_STATS.trianglesDrawn);
+		DrawOverlayText(renderer, 8, y, scale, line);
+		y += lineHeight;
+		snprintf(line, sizeof(line), "PIXELS %llu", GE_FRAME_STATS.pixelsFilled);
+		DrawOverlayText(renderer, 8, y, scale, line);
 	}
 
-	void SceneEditingHandle(SDL_Scancode scancode) {
-		//printf("SceneEditingHandle->");
-		switch (scancode) {
-		case SDL_SCANCODE_UP: {
-			//printf("Tapped SDL_SCANCODE_UP\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ 0, 0, 1 });
-			break;
+	void FinishFrameStats() {
+		// Counters go to the timeline, times are smoothed for the overlay
+		GE_PROFILER.recordCounter("Triangles submitted", GE_FRAME_STATS.trianglesSubmitted);
+		GE_PROFILER.recordCounter("Triangles culled", GE_FRAME_STATS.trianglesCulled);
+		GE_PROFILER.recordCounter("Triangles group culled", GE_FRAME_STATS.trianglesGroupCulled);
+		GE_PROFILER.recordCounter("Triangles skipped", GE_FRAME_STATS.trianglesSkipped);
+		GE_PROFILER.recordCounter("Triangles clipped", GE_FRAME_STATS.trianglesClipped);
+		GE_PROFILER.recordCounter("Triangles drawn", GE_FRAME_STATS.trianglesDrawn);
+		if (GE_OPTIONS.spanBuffer) {
+			GE_PROFILER.recordCounter("Triangles occluded", GE_FRAME_STATS.trianglesOccluded);
 		}
-		case SDL_SCANCODE_DOWN: {
-			//printf("Tapped SDL_SCANCODE_DOWN\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ 0, 0, -1 });
-			break;
+		GE_PROFILER.recordCounter("Pixels filled", (double)GE_FRAME_STATS.pixelsFilled);
+		GE_PROFILER.recordCounter("Latency ms", GE_FRAME_STATS.latencyMs);
+		GE_PROFILER.recordCounter("Render scale", renderScale);
+		if (GE_FRAME_STATS.inputLatencyMs > 0) {
+			GE_PROFILER.recordCounter("Input latency ms", GE_FRAME_STATS.inputLatencyMs);
+			GE_PROFILER.recordCounter("Input apply ms", GE_FRAME_STATS.inputApplyMs);
 		}
-		case SDL_SCANCODE_LEFT: {
-			//printf("Tapped SDL_SCANCODE_LEFT\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ 1, 0, 0 });
-			break;
+		if (GE_OPTIONS.pageBudgetMB > 0) {
+			if (sceneSnapshot != nullptr) {
+				GE_PROFILER.recordCounter("Resident MB", sceneSnapshot->residentMB);
+				GE_PROFILER.recordCounter("Regions paged out", (double)sceneSnapshot->regionsPagedOut);
+			} else {
+				GE_PROFILER.recordCounter("Resident MB", ResidentSceneBytes() / (1024.0 * 1024.0));
+				GE_PROFILER.recordCounter("Regions paged out", (double)CountPagedOutRegions());
+			}
 		}
-		case SDL_SCANCODE_RIGHT: {
-			//printf("Tapped SDL_SCANCODE_RIGHT\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ -1, 0, 0 });
-			break;
+
+		const double k = 0.1;
+		for (int i = 0; i < (int)PIPELINE_STAGES::COUNT; i++) {
+			GE_FRAME_STATS_SMOOTHED.stageMs[i] += (GE_FRAME_STATS.stageMs[i] - GE_FRAME_STATS_SMOOTHED.stageMs[i]) * k;
 		}
-		case SDL_SCANCODE_SPACE: {
-			//printf("Tapped SDL_SCANCODE_SPACE\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ 0, 1, 0 });
-			break;
+		GE_FRAME_STATS_SMOOTHED.frameMs += (GE_FRAME_STATS.frameMs - GE_FRAME_STATS_SMOOTHED.frameMs) * k;
+		GE_FRAME_STATS_SMOOTHED.latencyMs += (GE_FRAME_STATS.latencyMs - GE_FRAME_STATS_SMOOTHED.latencyMs) * k;
+		if (GE_FRAME_STATS.inputLatencyMs > 0) {
+			// Only frames showing a key count, the overlay keeps the last value in between
+			GE_FRAME_STATS_SMOOTHED.inputLatencyMs += (GE_FRAME_STATS.inputLatencyMs - GE_FRAME_STATS_SMOOTHED.inputLatencyMs) * k;
+			GE_FRAME_STATS_SMOOTHED.inputApplyMs += (GE_FRAME_STATS.inputApplyMs - GE_FRAME_STATS_SMOOTHED.inputApplyMs) * k;
 		}
-		case SDL_SCANCODE_X: {
-			//printf("Tapped SDL_SCANCODE_X\n");
-			GE_DRAW_LIST.selectorBox.moveBy({ 0, -1, 0 });
-			break;
+	}
+
+	void WriteProfile() {
+		std::string prefix = GE_OPTIONS.profilePrefix != nullptr ? GE_OPTIONS.profilePrefix : "3dge_profile";
+		std::string csvPath = prefix + ".csv";
+		std::string tracePath = prefix + ".json";
+		if (GE_PROFILER.writeCSV(csvPath.c_str()) && GE_PROFILER.writeChromeTrace(tracePath.c_str())) {
+			printf("Written profile to %s and %s\n", csvPath.c_str(), tracePath.c_str());
+		} else {
+			printf("Unable to write profile to %s\n", prefix.c_str());
 		}
-		case SDL_SCANCODE_F: {
-			//printf("Tapped SDL_SCANCODE_F\n");
-			CreateBlockAtSelectorPosition();
-			break;
+	}
+
+	// Calls vertexOut(position) for every new vertex and faceOut(indices, colorType) for every visible triangle.
+	// Regions go in key order and vertices are shared inside a region only, so the lookup table stays
+	// one region in size and every pass over the scene numbers vertices the same way.
+	template <typename VertexFunc, typename FaceFunc>
+	void ForEachExportTriangle(VertexFunc vertexOut, FaceFunc faceOut) {
+		const int n = REGION_SIZE + 1; // Block corners along a region
+		std::vector<unsigned int> cornerVertex(n * n * n);
+		std::vector<unsigned int> cornerTags(n * n * n, 0);
+		unsigned int tag = 0;
+		unsigned int nextVertex = 0;
+
+		std::vector<long long> regionKeys;
+		regionKeys.reserve(GE_DRAW_LIST.regions.size());
+		for (auto &entry : GE_DRAW_LIST.regions) {
+			if (entry.second.mesh != nullptr && !entry.second.mesh->visibleBlocks.empty()) {
+				regionKeys.push_back(entry.first);
+			}
 		}
-		case SDL_SCANCODE_R: {
-			//printf("Tapped SDL_SCANCODE_R\n");
-			RemoveBlockAtSelectorPosition();
-			break;
+		std::sort(regionKeys.begin(), regionKeys.end());
+
+		const GE_Object &cube = GE_STD_OBJECTS.CUBE;
+		for (long long regionKey : regionKeys) {
+			const GE_RegionMesh &mesh = *GE_DRAW_LIST.regions[regionKey].mesh;
+			const vec3 origin = { (float)mesh.originX, (float)mesh.originY, (float)mesh.originZ };
+			tag++;
+			for (const GE_MeshBlock &block : mesh.visibleBlocks) {
+				for (const Mesh_Side &side : cube.sides) {
+					if ((block.visibleSides & SideBit(side.type)) == 0) {
+						continue;
+					}
+					for (int t = side.first; t < side.first + side.count; t++) {
+						unsigned int indices[3];
+						for (int i = 0; i < 3; i++) {
+							// Template corners are at +-0.5 around the block centre
+							const vec3 &v = cube.mesh.vertices[cube.mesh.polygons[t].v[i]];
+							int cx = block.x + (v.x > 0 ? 1 : 0);
+							int cy = block.y + (v.y > 0 ? 1 : 0);
+							int cz = block.z + (v.z > 0 ? 1 : 0);
+							int corner = (cx * n + cy) * n + cz;
+							if (cornerTags[corner] != tag) {
+								cornerTags[corner] = tag;
+								cornerVertex[corner] = nextVertex++;
+								vertexOut(Vector3_Add(Vector3_Add(origin, block.getLocalPosition()), v));
+							}
+							indices[i] = cornerVertex[corner];
+						}
+						faceOut(indices, block.colorType);
+					}
+				}
+			}
 		}
-		case SDL_SCANCODE_E: {
-			//printf("Tapped SDL_SCANCODE_E\n");
-			ChangeBlockColorAtSelectorPosition();
-			break;
+
+		// Imported meshes are already indexed, their vertices only get shifted to the instance position
+		for (const GE_MeshInstance &instance : GE_DRAW_LIST.meshInstances) {
+			const GE_ImportedMesh &mesh = *instance.mesh;
+			unsigned int firstVertex = nextVertex;
+			for (const vec3 &v : mesh.vertices) {
+				vertexOut(Vector3_Add(instance.position, v));
+			}
+			nextVertex += (unsigned int)mesh.vertices.size();
+			for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+				unsigned int indices[3] = { firstVertex + mesh.indices[t], firstVertex + mesh.indices[t + 1], firstVertex + mesh.indices[t + 2] };
+				faceOut(indices, instance.colorType);
+			}
 		}
-		case SDL_SCANCODE_GRAVE: {
-			//printf("Tapped SDL_SCANCODE_GRAVE\n");
-			GE_CURRENT_KEYBOARD_CONTROL = Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_CAMERA_CONTROL;
-			break;
+	}
+
+	// Writes visible faces of the scene as Wavefront OBJ (with a .mtl of the block colors) or binary PLY,
+	// chosen by the extension of path
+	bool ExportScene(const char *path) {
+		if (!PageInAllRegions()) {
+			printf("Unable to export %s, regions of the scene could not be read back\n", path);
+			return false;
 		}
-		default:
-			printf("Tapped untreated key: %d\n", scancode);
-			break;
+		FlushRegionBuilds();
+		long long start = GE_PROFILER.now();
+		size_t pathLength = strlen(path);
+		bool ply = pathLength >= 4 && (strcmp(path + pathLength - 4, ".ply") == 0 || strcmp(path + pathLength - 4, ".PLY") == 0);
+
+		GE_StreamWriter out;
+		if (!out.open(path)) {
+			printf("Unable to export scene to %s\n", path);
+			return false;
+		}
+		unsigned long vertexCount = 0;
+		unsigned long triangleCount = 0;
+		if (ply) {
+			// Header needs the counts and vertices must come before faces, so the scene is walked three times
+			ForEachExportTriangle([&](const vec3 &) { vertexCount++; }, [&](const unsigned int *, unsigned char) { triangleCount++; });
+			out.print("ply\nformat binary_little_endian 1.0\ncomment 3DGE export\n"
+				"element vertex %lu\nproperty float x\nproperty float y\nproperty float z\n"
+				"element face %lu\nproperty list uchar int vertex_indices\nproperty uchar red\nproperty uchar green\nproperty uchar blue\n"
+				"end_header\n", vertexCount, triangleCount);
+			ForEachExportTriangle([&](const vec3 &v) {
+				out.writeValue(v.x);
+				out.writeValue(v.y);
+				out.writeValue(v.z);
+			}, [](const unsigned int *, unsigned char) {});
+			ForEachExportTriangle([](const vec3 &) {}, [&](const unsigned int *indices, unsigned char colorType) {
+				GE_Color color = GE_COLORS.getColorByType((Colors::Types)colorType);
+				unsigned char record[16];
+				record[0] = 3;
+				for (int i = 0; i < 3; i++) {
+					int index = (int)indices[i];
+					memcpy(record + 1 + 4 * i, &index, 4);
+				}
+				record[13] = (unsigned char)color.R;
+				record[14] = (unsigned char)color.G;
+				record[15] = (unsigned char)color.B;
+				out.write(record, sizeof(record));
+			});
+		} else {
+			// Materials go next to the OBJ, one per block color
+			std::string mtlPath = path;
+			size_t dot = mtlPath.find_last_of('.');
+			size_t slash = mtlPath.find_last_of("/\\");
+			mtlPath = (dot != std::string::npos && (slash == std::string::npos || dot > slash) ? mtlPath.substr(0, dot) : mtlPath) + ".mtl";
+			FILE *mtl = fopen(mtlPath.c_str(), "w");
+			if (mtl == NULL) {
+				printf("Unable to export materials to %s\n", mtlPath.c_str());
+				return false;
+			}
+			for (int i = 0; i < Colors::COUNT; i++) {
+				GE_Color color = GE_COLORS.getColorByType((Colors::Types)i);
+				fprintf(mtl, "newmtl %s\nKd %.4f %.4f %.4f\n", GE_COLORS.getColorName((Colors::Types)i), color.R / 255.0f, color.G / 255.0f, color.B / 255.0f);
+			}
+			fclose(mtl);
+
+			out.print("# 3DGE export\nmtllib %s\n", mtlPath.substr(slash == std::string::npos ? 0 : slash + 1).c_str());
+			int lastColorType = -1;
+			ForEachExportTriangle([&](const vec3 &v) {
+				out.print("v %g %g %g\n", v.x, v.y, v.z);
+				vertexCount++;
+			}, [&](const unsigned int *indices, unsigned char colorType) {
+				if (colorType != lastColorType) {
+					out.print("usemtl %s\n", GE_COLORS.getColorName((Colors::Types)colorType));
+					lastColorType = colorType;
+				}
+				out.print("f %u %u %u\n", indices[0] + 1, indices[1] + 1, indices[2] + 1);
+				triangleCount++;
+			});
+		}
+		unsigned long long bytes = out.bytesWritten();
+		if (!out.close()) {
+			printf("Error while writing %s\n", path);
+			return false;
 		}
+		printf("Exported %lu vertices and %lu triangles to %s (%.1f MB) in %.2f ms\n", vertexCount, triangleCount, path,
+			bytes / (1024.0 * 1024.0), (GE_PROFILER.now() - start) / 1000000.0);
+		return true;
 	}
 
-	void CameraMovementHandle(SDL_Scancode scancode) {
-		float offset = 20.0f / (float)FRAMES_PER_SECOND;
-		//printf("CameraMovementHandle->");
-		switch (scancode) {
-			// WASD
-		case SDL_SCANCODE_W: {
-			//printf("Tapped SDL_SCANCODE_W\n");
-			MainCamera.position.z += offset;
-			break;
+	// Loads vertices and faces of a Wavefront OBJ, polygons are split into fans and everything else
+	// (normals, texture coordinates, materials, groups) is ignored
+	bool ImportMesh(const char *path) {
+		FILE *f = fopen(path, "r");
+		if (f == NULL) {
+			printf("Unable to open mesh %s\n", path);
+			return false;
 		}
-		case SDL_SCANCODE_A: {
-			//printf("Tapped SDL_SCANCODE_A\n");
-			MainCamera.position.x += offset;
-			break;
+		long long start = GE_PROFILER.now();
+		std::shared_ptr<GE_ImportedMesh> mesh = std::make_shared<GE_ImportedMesh>();
+		const char *slash = strrchr(path, '/');
+		mesh->name = slash != NULL ? slash + 1 : path;
+
+		unsigned long lineNumber = 0;
+		unsigned long skippedFaces = 0;
+		std::vector<unsigned int> face;
+		std::vector<char> line(4096);
+		while (fgets(line.data(), (int)line.size(), f) != NULL) {
+			// Faces with many corners may be longer than the buffer
+			while (strchr(line.data(), '\n') == NULL && !feof(f)) {
+				size_t length = strlen(line.data());
+				line.resize(line.size() * 2);
+				if (fgets(line.data() + length, (int)(line.size() - length), f) == NULL) {
+					break;
+				}
+			}
+			lineNumber++;
+			const char *c = line.data();
+			if (c[0] == 'v' && isspace((unsigned char)c[1])) {
+				vec3 v;
+				char *end;
+				v.x = strtof(c + 1, &end);
+				v.y = strtof(end, &end);
+				v.z = strtof(end, &end);
+				mesh->vertices.push_back(v);
+			} else if (c[0] == 'f' && isspace((unsigned char)c[1])) {
+				// Corner is v, v/vt, v//vn or v/vt/vn, negative indices count back from the last vertex
+				face.clear();
+				bool valid = true;
+				c++;
+				for (;;) {
+					while (isspace((unsigned char)*c)) {
+						c++;
+					}
+					if (*c == '\0') {
+						break;
+					}
+					char *end;
+					long index = strtol(c, &end, 10);
+					long resolved = index < 0 ? (long)mesh->vertices.size() + index : index - 1;
+					if (end == c || index == 0 || resolved < 0 || resolved >= (long)mesh->vertices.size()) {
+						valid = false;
+						break;
+					}
+					face.push_back((unsigned int)resolved);
+					c = end;
+					while (*c != '\0' && !isspace((unsigned char)*c)) {
+						c++;
+					}
+				}
+				if (!valid || face.size() < 3) {
+					skippedFaces++;
+					continue;
+				}
+				for (size_t i = 1; i + 1 < face.size(); i++) {
+					mesh->indices.push_back(face[0]);
+					mesh->indices.push_back(face[i]);
+					mesh->indices.push_back(face[i + 1]);
+				}
+			}
 		}
-		case SDL_SCANCODE_S: {
-			//printf("Tapped SDL_SCANCODE_S\n");
-			MainCamera.position.z -= offset;
-			break;
+		fclose(f);
+		if (mesh->indices.empty()) {
+			printf("No faces in mesh %s\n", path);
+			return false;
 		}
-		case SDL_SCANCODE_D: {
-			//printf("Tapped SDL_SCANCODE_D\n");
-			MainCamera.position.x -= offset;
-			break;
+
+		// Centred on the origin like the built-in templates, so it is placed around the selector
+		vec3 boundsMin = mesh->vertices[0], boundsMax = boundsMin;
+		for (const vec3 &v : mesh->vertices) {
+			boundsMin = { std::min(boundsMin.x, v.x), std::min(boundsMin.y, v.y), std::min(boundsMin.z, v.z) };
+			boundsMax = { std::max(boundsMax.x, v.x), std::max(boundsMax.y, v.y), std::max(boundsMax.z, v.z) };
 		}
-		case SDL_SCANCODE_SPACE: {
-			//printf("Tapped SDL_SCANCODE_SPACE\n");
-			MainCamera.position.y += offset;
-			break;
+		vec3 centre = Vector3_Mul(Vector3_Add(boundsMin, boundsMax), 0.5f);
+		for (vec3 &v : mesh->vertices) {
+			v = Vector3_Sub(v, centre);
 		}
-		case SDL_SCANCODE_X: {
-			//printf("Tapped SDL_SCANCODE_X\n");
-			MainCamera.position.y -= offset;
-			break;
+		long long loaded = GE_PROFILER.now();
+		mesh->bvh.build(mesh->vertices, mesh->indices);
+		long long built = GE_PROFILER.now();
+
+		vec3 size = Vector3_Sub(boundsMax, boundsMin);
+		printf("Imported %s: %zu vertices, %zu triangles, size %.2f %.2f %.2f, loaded in %.2f ms, %zu BVH nodes built in %.2f ms\n",
+			mesh->name.c_str(), mesh->vertices.size(), mesh->indices.size() / 3, size.x, size.y, size.z,
+			(loaded - start) / 1000000.0, mesh->bvh.nodes.size(), (built - loaded) / 1000000.0);
+		if (skippedFaces > 0) {
+			printf("Skipped %lu faces with invalid vertex indices\n", skippedFaces);
 		}
-		case SDL_SCANCODE_UP: {
-			//printf("Tapped SDL_SCANCODE_UP\n");
-			MainCamera.fXRotation -= offset;
-			break;
+		GE_DRAW_LIST.importedMeshes.push_back(mesh);
+		return true;
+	}
+
+	void resetMainCamera() {
+		MainCamera.position = { 3, 4, 0 };
+		MainCamera.lookDirection = { 0, 0, 1 };
+		MainCamera.fXRotation = M_PI / 6.0f; //3.14159f / 1000.0f;
+		MainCamera.fYRotation = M_PI / 8.0f; // 3.14159f / 4.0f;
+		MainCamera.fFOV = 90.0f;
+		MainCamera.fNear = 0.1f;
+		MainCamera.fFar = 1000.0f;
+	}
+
+	GE_SlotHandle getBlockHandleByPos(vec3 pos) {
+		auto it = GE_DRAW_LIST.blockByCell.find(CellKey(pos));
+		return it != GE_DRAW_LIST.blockByCell.end() ? it->second : GE_SlotHandle();
+	}
+
+	// Pointer is only valid until the next block is created or removed
+	GE_Block* getBlockByPos(vec3 pos) {
+		return GE_DRAW_LIST.blocks.get(getBlockHandleByPos(pos));
+	}
+
+	// Cells a key can tell apart, coordinates outside wrap onto other cells
+	static const long CELL_COORD_LIMIT = 1 << 20;
+
+	static bool IsCellInRange(long x, long y, long z) {
+		auto axis = [](long v) { return v >= -CELL_COORD_LIMIT && v < CELL_COORD_LIMIT; };
+		return axis(x) && axis(y) && axis(z);
+	}
+
+	static long long PackCellKey(int x, int y, int z) {
+		// Packs integer grid position into one key (21 bits per axis)
+		return (((long long)x & 0x1FFFFF) << 42) | (((long long)y & 0x1FFFFF) << 21) | ((long long)z & 0x1FFFFF);
+	}
+
+	static void UnpackCellKey(long long key, int &x, int &y, int &z) {
+		// Sign-extends every 21-bit axis back
+		auto axis = [](long long bits) { return (int)(bits & 0x100000 ? bits - 0x200000 : bits); };
+		x = axis((key >> 42) & 0x1FFFFF);
+		y = axis((key >> 21) & 0x1FFFFF);
+		z = axis(key & 0x1FFFFF);
+	}
+
+	long long CellKey(vec3 pos) {
+		return PackCellKey(lroundf(pos.x), lroundf(pos.y), lroundf(pos.z));
+	}
+
+	static int RegionCoord(int cell) {
+		// Floor division, so negative cells land in negative regions
+		return cell >= 0 ? cell / REGION_SIZE : -((-cell + REGION_SIZE - 1) / REGION_SIZE);
+	}
+
+	static long long RegionKeyOfCell(int x, int y, int z) {
+		return PackCellKey(RegionCoord(x), RegionCoord(y), RegionCoord(z));
+	}
+
+	bool isCellOccupied(vec3 pos) {
+		return GE_DRAW_LIST.blockByCell.count(CellKey(pos)) != 0;
+	}
+
+	vec3 getSideNormal(GE_MESH_SIDE_TYPE type) {
+		switch (type) {
+		case GE_MESH_SIDE_TYPE::EAST: return { 1, 0, 0 };
+		case GE_MESH_SIDE_TYPE::TOP: return { 0, 1, 0 };
+		case GE_MESH_SIDE_TYPE::NORTH: return { 0, 0, 1 };
+		case GE_MESH_SIDE_TYPE::WEST: return { -1, 0, 0 };
+		case GE_MESH_SIDE_TYPE::BOTTOM: return { 0, -1, 0 };
+		case GE_MESH_SIDE_TYPE::SOUTH: return { 0, 0, -1 };
+		default: return { 0, 0, 0 };
+		}
+	}
+
+	template <typename Occupied>
+	unsigned long long ComputeAmbientOcclusion(vec3 blockPos, Occupied isOccupied) {
+		// Standard voxel corner AO: every face vertex looks at the two edge neighbours
+		// and the corner neighbour in the layer of cells in front of the face.
+		// Only reads the cube template, so region builds call it from worker threads
+		GE_Object &cube = GE_STD_OBJECTS.CUBE;
+		unsigned long long aoLevels = 0;
+		for (Mesh_Side &side : cube.sides) {
+			int sideIndex = SideIndex(side.type);
+			vec3 normal = getSideNormal(side.type);
+			vec3 front = Vector3_Add(blockPos, normal);
+			for (int c = 0; c < 4; c++) {
+				// Direction to the corner, zeroed along the normal
+				vec3 d = cube.mesh.vertices[cubeSideCorners[sideIndex][c]];
+				vec3 u = { 0, 0, 0 };
+				vec3 v = { 0, 0, 0 };
+				if (normal.x != 0) {
+					u.y = d.y > 0 ? 1.0f : -1.0f;
+					v.z = d.z > 0 ? 1.0f : -1.0f;
+				} else if (normal.y != 0) {
+					u.x = d.x > 0 ? 1.0f : -1.0f;
+					v.z = d.z > 0 ? 1.0f : -1.0f;
+				} else {
+					u.x = d.x > 0 ? 1.0f : -1.0f;
+					v.y = d.y > 0 ? 1.0f : -1.0f;
+				}
+				vec3 side1Pos = Vector3_Add(front, u);
+				vec3 side2Pos = Vector3_Add(front, v);
+				vec3 cornerPos = Vector3_Add(side1Pos, v);
+				bool side1 = isOccupied(side1Pos);
+				bool side2 = isOccupied(side2Pos);
+				bool corner = isOccupied(cornerPos);
+				unsigned long long level = (side1 && side2) ? 0 : 3 - (side1 + side2 + corner);
+				aoLevels |= level << (2 * (4 * sideIndex + c));
+			}
+		}
+		return aoLevels;
+	}
+
+	std::shared_ptr<const GE_RegionMesh> BuildRegionMesh(const GE_RegionSnapshot &snapshot) {
+		// Runs on a worker thread, everything it needs is in the snapshot
+		const int n = REGION_SNAPSHOT_SIZE;
+		auto cellAt = [&](int x, int y, int z) {
+			return snapshot.cells[((x - snapshot.originX) * n + (y - snapshot.originY)) * n + (z - snapshot.originZ)];
+		};
+		auto isOccupied = [&](vec3 pos) {
+			return cellAt((int)lroundf(pos.x), (int)lroundf(pos.y), (int)lroundf(pos.z)) != 0;
+		};
+
+		std::shared_ptr<GE_RegionMesh> mesh = std::make_shared<GE_RegionMesh>();
+		mesh->originX = snapshot.originX + 1;
+		mesh->originY = snapshot.originY + 1;
+		mesh->originZ = snapshot.originZ + 1;
+		for (int x = snapshot.originX + 1; x < snapshot.originX + n - 1; x++) {
+			for (int y = snapshot.originY + 1; y < snapshot.originY + n - 1; y++) {
+				for (int z = snapshot.originZ + 1; z < snapshot.originZ + n - 1; z++) {
+					unsigned char cell = cellAt(x, y, z);
+					if (cell == 0) {
+						continue;
+					}
+					GE_Block block;
+					block.x = x;
+					block.y = y;
+					block.z = z;
+					block.colorType = cell - 1;
+					vec3 blockPos = block.getPosition();
+					for (const GE_SideNeighbour &neighbour : SIDE_NEIGHBOURS) {
+						if (isOccupied(Vector3_Add(blockPos, neighbour.offset))) {
+							block.hideSide(neighbour.sideType);
+						}
+					}
+					if (block.visibleSides != 0) {
+						unsigned long long aoLevels = ComputeAmbientOcclusion(blockPos, isOccupied);
+						GE_MeshBlock meshBlock;
+						meshBlock.x = (unsigned char)(x - mesh->originX);
+						meshBlock.y = (unsigned char)(y - mesh->originY);
+						meshBlock.z = (unsigned char)(z - mesh->originZ);
+						meshBlock.visibleSides = block.visibleSides;
+						meshBlock.colorType = block.colorType;
+						for (int i = 0; i < 3; i++) {
+							meshBlock.ao[i] = (unsigned short)(aoLevels >> (16 * i));
+						}
+						mesh->visibleBlocks.push_back(meshBlock);
+					}
+				}
+			}
+		}
+		GroupBlocksBySides(*mesh);
+		return mesh;
+	}
+
+	// Orders blocks by side mask, so a frame can skip a whole group once the camera is behind all of its sides
+	void GroupBlocksBySides(GE_RegionMesh &mesh) {
+		std::vector<GE_MeshBlock> &blocks = mesh.visibleBlocks;
+		std::stable_sort(blocks.begin(), blocks.end(), [](const GE_MeshBlock &a, const GE_MeshBlock &b) {
+			return a.visibleSides < b.visibleSides;
+		});
+		mesh.sideGroups.clear();
+		for (unsigned int i = 0; i < blocks.size(); i++) {
+			if (mesh.sideGroups.empty() || mesh.sideGroups.back().sides != blocks[i].visibleSides) {
+				mesh.sideGroups.push_back({ blocks[i].visibleSides, i, 0 });
+			}
+			mesh.sideGroups.back().count++;
+		}
+
+		for (int &nearest : mesh.nearestSide) {
+			nearest = INT_MAX;
+		}
+		for (const GE_MeshBlock &block : blocks) {
+			const int x = mesh.originX + block.x, y = mesh.originY + block.y, z = mesh.originZ + block.z;
+			for (const GE_SideNeighbour &neighbour : SIDE_NEIGHBOURS) {
+				if (block.visibleSides & SideBit(neighbour.sideType)) {
+					int &nearest = mesh.nearestSide[SideIndex(neighbour.sideType)];
+					nearest = std::min(nearest, (int)neighbour.offset.x * x + (int)neighbour.offset.y * y + (int)neighbour.offset.z * z);
+				}
+			}
+		}
+	}
+
+	// Calls group(region, mesh, group, sides) with the sides of every side group the camera may face
+	template <typename GroupFunc>
+	void ForEachFrontSideGroup(GE_FrameGeometry &geometry, const vec3 &eye, GroupFunc groupFunc) {
+		const std::vector<Mesh_Side> &cubeSides = GE_STD_OBJECTS.CUBE.sides;
+		for (unsigned int region = 0; region < geometry.input.regionMeshes.size(); region++) {
+			const std::shared_ptr<const GE_RegionMesh> &mesh = geometry.input.regionMeshes[region];
+			const unsigned char frontSides = FrontSidesOfRegion(*mesh, eye);
+			for (const GE_SideGroup &group : mesh->sideGroups) {
+				// Sides the camera is behind count as culled without being transformed
+				const unsigned char sides = group.sides & frontSides;
+				for (const Mesh_Side &side : cubeSides) {
+					if ((group.sides & ~sides) & SideBit(side.type)) {
+						geometry.stats.trianglesGroupCulled += side.count * group.count;
+					}
+				}
+				if (sides != 0) {
+					groupFunc(region, *mesh, group, sides);
+				}
+			}
+		}
+	}
+
+	// Cell of the camera in the block grid
+	static void EyeCell(const GE_FrameInput &input, int eyeCell[3]) {
+		const Matrix4 matWorld = WorldMatrix();
+		eyeCell[0] = (int)lroundf(input.cameraPosition.x - matWorld.m[3][0]);
+		eyeCell[1] = (int)lroundf(input.cameraPosition.y - matWorld.m[3][1]);
+		eyeCell[2] = (int)lroundf(input.cameraPosition.z - matWorld.m[3][2]);
+	}
+
+	static unsigned int CellDistance(int x, int y, int z, const int eyeCell[3]) {
+		return abs(x - eyeCell[0]) + abs(y - eyeCell[1]) + abs(z - eyeCell[2]);
+	}
+
+	// Counting sort of the blocks by Manhattan distance of their cell to the camera cell, furthest first.
+	// A ray from the camera moves away from its cell along every axis, so a block the ray passes before
+	// another one is nearer by this distance: drawing the far buckets first is painter's order for the grid,
+	// and blocks of one bucket never overlap on screen. Visible sides of a cube never overlap either
+	void OrderBlocksByCellDistance(GE_FrameGeometry &geometry, const vec3 &eye) {
+		int eyeCell[3];
+		EyeCell(geometry.input, eyeCell);
+		std::vector<GE_OrderedBlock> &facing = geometry.blocksFacing;
+		std::vector<GE_OrderedBlock> &ordered = geometry.blocksOrdered;
+		std::vector<unsigned int> &counts = geometry.blockDistanceCounts;
+		facing.clear();
+		geometry.regionMatrices.clear();
+		for (const std::shared_ptr<const GE_RegionMesh> &mesh : geometry.input.regionMeshes) {
+			geometry.regionMatrices.push_back(RegionMatrix(WorldMatrix(), *mesh));
+		}
+		unsigned int maxDistance = 0;
+		ForEachFrontSideGroup(geometry, eye, [&](unsigned int region, const GE_RegionMesh &mesh, const GE_SideGroup &group, unsigned char sides) {
+			for (unsigned int i = group.first; i < group.first + group.count; i++) {
+				const GE_MeshBlock &block = mesh.visibleBlocks[i];
+				unsigned int distance = CellDistance(mesh.originX + block.x, mesh.originY + block.y, mesh.originZ + block.z, eyeCell);
+				maxDistance = std::max(maxDistance, distance);
+				facing.push_back({ block, region, sides, distance });
+			}
+		});
+
+		// Start of every bucket, the furthest one first
+		counts.assign(maxDistance + 1, 0);
+		for (const GE_OrderedBlock &entry : facing) {
+			counts[entry.distance]++;
+		}
+		unsigned int start = 0;
+		for (unsigned int d = maxDistance + 1; d-- > 0;) {
+			unsigned int count = counts[d];
+			counts[d] = start;
+			start += count;
+		}
+		ordered.resize(facing.size());
+		for (const GE_OrderedBlock &entry : facing) {
+			ordered[counts[entry.distance]++] = entry;
+		}
+	}
+
+	// Sides of the mesh the eye (relative to the block grid) may see. A side is behind the eye on every block
+	// once the eye is not in front of the nearest of its planes; the margin leaves the edge cases to the per triangle test
+	unsigned char FrontSidesOfRegion(const GE_RegionMesh &mesh, const vec3 &eye) {
+		unsigned char sides = 0;
+		for (const GE_SideNeighbour &neighbour : SIDE_NEIGHBOURS) {
+			float eyeDistance = Vector3_DotProduct(neighbour.offset, eye) - 0.5f;
+			if (eyeDistance > mesh.nearestSide[SideIndex(neighbour.sideType)] - 0.01f) {
+				sides |= SideBit(neighbour.sideType);
+			}
+		}
+		return sides;
+	}
+
+	void MarkRegionsDirtyAround(int x, int y, int z) {
+		// Sides and AO of a block depend on its 26 neighbours, so an edit can reach into adjacent regions
+		for (int dx = -1; dx <= 1; dx += 2) {
+			for (int dy = -1; dy <= 1; dy += 2) {
+				for (int dz = -1; dz <= 1; dz += 2) {
+					GE_DRAW_LIST.dirtyRegions.insert(RegionKeyOfCell(x + dx, y + dy, z + dz));
+				}
+			}
+		}
+	}
+
+	void DispatchRegionBuilds() {
+		if (GE_DRAW_LIST.dirtyRegions.empty()) {
+			return;
+		}
+		GE_ProfileScope scope(GE_PROFILER, "Region dispatch");
+		const int n = REGION_SNAPSHOT_SIZE;
+		std::unordered_map<long long, std::shared_ptr<GE_RegionSnapshot>> snapshots;
+		for (long long regionKey : GE_DRAW_LIST.dirtyRegions) {
+			std::shared_ptr<GE_RegionSnapshot> snapshot = std::make_shared<GE_RegionSnapshot>();
+			int rx, ry, rz;
+			UnpackCellKey(regionKey, rx, ry, rz);
+			snapshot->originX = rx * REGION_SIZE - 1;
+			snapshot->originY = ry * REGION_SIZE - 1;
+			snapshot->originZ = rz * REGION_SIZE - 1;
+			snapshot->cells.assign(n * n * n, 0);
+			snapshots[regionKey] = snapshot;
+		}
+		GE_DRAW_LIST.dirtyRegions.clear();
+
+		if (snapshots.size() * n * n * n < GE_DRAW_LIST.blocks.size()) {
+			// Few regions: look their cells up
+			for (auto &entry : snapshots) {
+				GE_RegionSnapshot &snapshot = *entry.second;
+				for (int x = 0; x < n; x++) {
+					for (int y = 0; y < n; y++) {
+						for (int z = 0; z < n; z++) {
+							auto it = GE_DRAW_LIST.blockByCell.find(PackCellKey(snapshot.originX + x, snapshot.originY + y, snapshot.originZ + z));
+							if (it != GE_DRAW_LIST.blockByCell.end()) {
+								snapshot.cells[(x * n + y) * n + z] = GE_DRAW_LIST.blocks.get(it->second)->colorType + 1;
+							}
+						}
+					}
+				}
+			}
+		} else {
+			// Many regions: one pass over all blocks, a block lands in up to 8 regions counting borders
+			for (GE_Block &block : GE_DRAW_LIST.blocks) {
+				long long written[8];
+				int writtenCount = 0;
+				for (int corner = 0; corner < 8; corner++) {
+					long long regionKey = RegionKeyOfCell(block.x + (corner & 1 ? 1 : -1), block.y + (corner & 2 ? 1 : -1), block.z + (corner & 4 ? 1 : -1));
+					if (std::find(written, written + writtenCount, regionKey) != written + writtenCount) {
+						continue;
+					}
+					written[writtenCount++] = regionKey;
+					auto it = snapshots.find(regionKey);
+					if (it != snapshots.end()) {
+						GE_RegionSnapshot &snapshot = *it->second;
+						int x = block.x - snapshot.originX;
+						int y = block.y - snapshot.originY;
+						int z = block.z - snapshot.originZ;
+						if (x >= 0 && x < n && y >= 0 && y < n && z >= 0 && z < n) {
+							snapshot.cells[(x * n + y) * n + z] = block.colorType + 1;
+						}
+					}
+				}
+			}
+		}
+
+		// Compressed regions are decoded straight into the snapshots touching them, they stay compressed
+		for (auto &entry : snapshots) {
+			GE_RegionSnapshot &snapshot = *entry.second;
+			int rx, ry, rz;
+			UnpackCellKey(entry.first, rx, ry, rz);
+			for (int dx = -1; dx <= 1; dx++) {
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dz = -1; dz <= 1; dz++) {
+						long long neighbourKey = PackCellKey(rx + dx, ry + dy, rz + dz);
+						auto it = GE_DRAW_LIST.regionPages.find(neighbourKey);
+						if (it == GE_DRAW_LIST.regionPages.end() || it->second.state != GE_PAGE_STATE::COMPRESSED) {
+							continue;
+						}
+						ForEachPackedBlock(neighbourKey, it->second.packed, [&](int x, int y, int z, unsigned char colorType) {
+							x -= snapshot.originX;
+							y -= snapshot.originY;
+							z -= snapshot.originZ;
+							if (x >= 0 && x < n && y >= 0 && y < n && z >= 0 && z < n) {
+								snapshot.cells[(x * n + y) * n + z] = colorType + 1;
+							}
+						});
+					}
+				}
+			}
+		}
+
+		for (auto &entry : snapshots) {
+			long long regionKey = entry.first;
+			std::shared_ptr<GE_RegionSnapshot> snapshot = entry.second;
+			unsigned long build = ++regionBuildSerial;
+			GE_DRAW_LIST.regions[regionKey].requestedBuild = build;
+			regionBuildPool.enqueue([this, regionKey, build, snapshot]() {
+				GE_ProfileScope scope(GE_PROFILER, "Region build");
+				std::shared_ptr<const GE_RegionMesh> mesh = BuildRegionMesh(*snapshot);
+				std::lock_guard<std::mutex> guard(regionResultsLock);
+				regionResults.push_back({ regionKey, build, mesh });
+			});
+		}
+	}
+
+	// Returns false if no build had finished
+	bool InstallFinishedRegionMeshes() {
+		std::vector<GE_RegionBuildResult> results;
+		{
+			std::lock_guard<std::mutex> guard(regionResultsLock);
+			results.swap(regionResults);
+		}
+		for (GE_RegionBuildResult &result : results) {
+			auto it = GE_DRAW_LIST.regions.find(result.regionKey);
+			// An older build may finish after a newer one, latest edit wins
+			if (it == GE_DRAW_LIST.regions.end() || result.build <= it->second.installedBuild) {
+				continue;
+			}
+			// Region was evicted while it was built, it draws empty until it is loaded and rebuilt
+			auto page = GE_DRAW_LIST.regionPages.find(result.regionKey);
+			if (page != GE_DRAW_LIST.regionPages.end() && !IsPageResident(page->second)) {
+				continue;
+			}
+			GE_Region &region = it->second;
+			region.mesh = result.mesh;
+			region.installedBuild = result.build;
+			if (region.mesh->visibleBlocks.empty() && region.installedBuild == region.requestedBuild) {
+				GE_DRAW_LIST.regions.erase(it);
+			}
+		}
+		return !results.empty();
+	}
+
+	void FlushRegionBuilds() {
+		// Headless modes wait for rebuilds, so every run draws the same frames
+		DispatchRegionBuilds();
+		regionBuildPool.waitIdle();
+		InstallFinishedRegionMeshes();
+	}
+
+	// Estimated memory of an expanded block: packed value, slot table entries and the node of its cell map entry
+	static const size_t RESIDENT_BYTES_PER_BLOCK = sizeof(GE_Block) + 3 * sizeof(unsigned int) + sizeof(long long) + sizeof(GE_SlotHandle) + 2 * sizeof(void *);
+	static const int PAGE_PREFETCH_FRAMES = 30; // How far ahead along the camera movement regions are loaded
+	static const int COMPRESS_REGIONS_PER_FRAME = 64; // Keeps compression of a freshly built scene from stalling a frame
+	static const int PAGE_READ_RETRIES = 3; // Background loads of an unreadable region before it is left paged out
+
+	void CountRegionBlock(int x, int y, int z, int delta) {
+		auto it = GE_DRAW_LIST.regionPages.emplace(RegionKeyOfCell(x, y, z), GE_RegionPage()).first;
+		it->second.blockCount += delta;
+		it->second.lastEditFrame = regionFrame;
+		if (it->second.blockCount == 0 && it->second.state == GE_PAGE_STATE::EXPANDED) {
+			GE_DRAW_LIST.regionPages.erase(it);
+		}
+	}
+
+	// Cells of a region are ordered layer by layer (y outermost), so terrain turns into a run or two per layer
+	static int RegionCellIndex(int x, int y, int z) {
+		return ((y & (REGION_SIZE - 1)) * REGION_SIZE + (x & (REGION_SIZE - 1))) * REGION_SIZE + (z & (REGION_SIZE - 1));
+	}
+
+	// Calls cell(x, y, z, colorType) for every block of a packed region, returns false if the data is corrupt
+	template <typename CellFunc>
+	static bool ForEachPackedBlock(long long regionKey, const std::vector<unsigned char> &packed, CellFunc cell) {
+		int rx, ry, rz;
+		UnpackCellKey(regionKey, rx, ry, rz);
+		return GE_PaletteRLE_Decode(packed, REGION_SIZE * REGION_SIZE * REGION_SIZE, [&](size_t first, size_t length, unsigned char value) {
+			if (value == 0) {
+				return;
+			}
+			for (size_t i = first; i < first + length; i++) {
+				int index = (int)i;
+				cell(rx * REGION_SIZE + index / REGION_SIZE % REGION_SIZE, ry * REGION_SIZE + index / (REGION_SIZE * REGION_SIZE),
+					rz * REGION_SIZE + index % REGION_SIZE, (unsigned char)(value - 1));
+			}
+		});
+	}
+
+	// Takes the blocks of an expanded region out of the slot map and the cell map, packed as palette + RLE
+	void PackRegionBlocks(long long regionKey, std::vector<unsigned char> &packed) {
+		int rx, ry, rz;
+		UnpackCellKey(regionKey, rx, ry, rz);
+		unsigned char cells[REGION_SIZE * REGION_SIZE * REGION_SIZE] = { 0 };
+		for (int x = rx * REGION_SIZE; x < (rx + 1) * REGION_SIZE; x++) {
+			for (int y = ry * REGION_SIZE; y < (ry + 1) * REGION_SIZE; y++) {
+				for (int z = rz * REGION_SIZE; z < (rz + 1) * REGION_SIZE; z++) {
+					auto it = GE_DRAW_LIST.blockByCell.find(PackCellKey(x, y, z));
+					if (it != GE_DRAW_LIST.blockByCell.end()) {
+						cells[RegionCellIndex(x, y, z)] = GE_DRAW_LIST.blocks.get(it->second)->colorType + 1;
+						GE_DRAW_LIST.blocks.remove(it->second);
+						GE_DRAW_LIST.blockByCell.erase(it);
+					}
+				}
+			}
+		}
+		GE_PaletteRLE_Encode(cells, sizeof(cells), packed);
+	}
+
+	void ExpandRegion(long long regionKey, GE_RegionPage &page) {
+		ForEachPackedBlock(regionKey, page.packed, [&](int x, int y, int z, unsigned char colorType) {
+			auto inserted = GE_DRAW_LIST.blockByCell.emplace(PackCellKey(x, y, z), GE_SlotHandle());
+			if (inserted.second) {
+				GE_Block block;
+				block.x = x;
+				block.y = y;
+				block.z = z;
+				block.colorType = colorType;
+				inserted.first->second = GE_DRAW_LIST.blocks.insert(block);
+			}
+		});
+		std::vector<unsigned char>().swap(page.packed);
+		page.state = GE_PAGE_STATE::EXPANDED;
+	}
+
+	// Calls block(x, y, z, colorType) for every block in memory, expanded or compressed, in no particular order
+	template <typename BlockFunc>
+	void ForEachSceneBlock(BlockFunc block) {
+		for (const GE_Block &b : GE_DRAW_LIST.blocks) {
+			block(b.x, b.y, b.z, b.colorType);
+		}
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			if (entry.second.state == GE_PAGE_STATE::COMPRESSED) {
+				ForEachPackedBlock(entry.first, entry.second.packed, block);
+			}
+		}
+	}
+
+	// Position of some block in memory, prefers expanded ones so nothing has to be unpacked
+	bool AnySceneBlockPosition(vec3 &pos) {
+		if (!GE_DRAW_LIST.blocks.empty()) {
+			pos = GE_DRAW_LIST.blocks.front().getPosition();
+			return true;
+		}
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			if (entry.second.state == GE_PAGE_STATE::COMPRESSED) {
+				bool found = false;
+				ForEachPackedBlock(entry.first, entry.second.packed, [&](int x, int y, int z, unsigned char) {
+					if (!found) {
+						pos = { (float)x, (float)y, (float)z };
+						found = true;
+					}
+				});
+				return found;
+			}
+		}
+		return false;
+	}
+
+	size_t SceneBlockCount() {
+		size_t count = 0;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			count += entry.second.blockCount;
+		}
+		return count;
+	}
+
+	size_t ResidentRegionBytes(long long regionKey, const GE_RegionPage &page) {
+		size_t bytes = page.state == GE_PAGE_STATE::EXPANDED ? page.blockCount * RESIDENT_BYTES_PER_BLOCK : page.packed.capacity();
+		auto it = GE_DRAW_LIST.regions.find(regionKey);
+		if (it != GE_DRAW_LIST.regions.end() && it->second.mesh != nullptr) {
+			bytes += it->second.mesh->visibleBlocks.size() * sizeof(GE_MeshBlock);
+		}
+		return bytes;
+	}
+
+	size_t CountPagedOutRegions() {
+		size_t pagedRegions = 0;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			pagedRegions += entry.second.state == GE_PAGE_STATE::PAGED_OUT || entry.second.state == GE_PAGE_STATE::LOADING ? 1 : 0;
+		}
+		return pagedRegions;
+	}
+
+	size_t ResidentSceneBytes() {
+		size_t bytes = GE_DRAW_LIST.blocks.size() * RESIDENT_BYTES_PER_BLOCK;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			bytes += entry.second.packed.capacity();
+		}
+		for (auto &entry : GE_DRAW_LIST.regions) {
+			if (entry.second.mesh != nullptr) {
+				bytes += entry.second.mesh->visibleBlocks.size() * sizeof(GE_MeshBlock);
+			}
+		}
+		return bytes;
+	}
+
+	// Packs regions nobody edited for --compress-after frames, their meshes stay as they are.
+	// Everything is packed at once when all is set, used by headless modes after building a scene
+	void CompressInactiveRegions(bool all = false) {
+		if (GE_OPTIONS.compressAfterFrames < 0) {
+			return;
+		}
+		GE_ProfileScope scope(GE_PROFILER, "Region compress");
+		int compressed = 0;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			GE_RegionPage &page = entry.second;
+			if (page.state != GE_PAGE_STATE::EXPANDED || (!all && regionFrame - page.lastEditFrame < (unsigned long)GE_OPTIONS.compressAfterFrames)) {
+				continue;
+			}
+			PackRegionBlocks(entry.first, page.packed);
+			page.packed.shrink_to_fit();
+			page.state = GE_PAGE_STATE::COMPRESSED;
+			regionsCompressed++;
+			if (!all && ++compressed == COMPRESS_REGIONS_PER_FRAME) {
+				break;
+			}
+		}
+		if (all) {
+			GE_DRAW_LIST.blocks.shrink_to_fit();
+			GE_DRAW_LIST.blockByCell.rehash(0);
+		}
+	}
+
+	// Drops the region from memory and hands its packed cells to the page store, the region draws empty from now on
+	void EvictRegion(long long regionKey, GE_RegionPage &page) {
+		std::shared_ptr<std::vector<unsigned char>> packed = std::make_shared<std::vector<unsigned char>>();
+		if (page.state == GE_PAGE_STATE::EXPANDED) {
+			PackRegionBlocks(regionKey, *packed);
+		} else {
+			packed->swap(page.packed);
+		}
+		GE_DRAW_LIST.regions.erase(regionKey);
+		page.state = GE_PAGE_STATE::PAGED_OUT;
+		page.loadSerial = ++pageSerial;
+		page.failedReads = 0;
+		regionsPagedOut++;
+
+		// Reads find the cells in memory until they are written
+		{
+			std::lock_guard<std::mutex> guard(pageStoreLock);
+			pageWritesPending[regionKey] = packed;
+		}
+		pagingPool.enqueue([this, regionKey, packed]() {
+			GE_ProfileScope scope(GE_PROFILER, "Region page out");
+			std::lock_guard<std::mutex> guard(pageStoreLock);
+			if (!pageStore.write(regionKey, *packed)) {
+				// Cells stay pending as well, so a direct read still finds them
+				if (!pageWriteFailed.exchange(true)) {
+					printf("Unable to write to page store, paging out stopped\n");
+				}
+				std::lock_guard<std::mutex> resultsGuard(pageResultsLock);
+				pageResults.push_back({ regionKey, 0, *packed, false });
+				return;
+			}
+			auto it = pageWritesPending.find(regionKey);
+			if (it != pageWritesPending.end() && it->second == packed) {
+				pageWritesPending.erase(it); // A later eviction of the region keeps its own entry
+			}
+		});
+	}
+
+	// Caller holds pageStoreLock. Returns false if the cells could not be read or do not decode
+	bool ReadRegionPage(long long regionKey, std::vector<unsigned char> &packed) {
+		auto it = pageWritesPending.find(regionKey);
+		if (it != pageWritesPending.end()) {
+			packed = *it->second;
+		} else if (!pageStore.read(regionKey, packed)) {
+			return false;
+		}
+		return ForEachPackedBlock(regionKey, packed, [](int, int, int, unsigned char) {});
+	}
+
+	void RequestRegionLoad(long long regionKey, GE_RegionPage &page) {
+		page.state = GE_PAGE_STATE::LOADING;
+		page.loadSerial = ++pageSerial;
+		unsigned long serial = page.loadSerial;
+		pagingPool.enqueue([this, regionKey, serial]() {
+			GE_ProfileScope scope(GE_PROFILER, "Region page in");
+			GE_PageLoadResult result;
+			result.regionKey = regionKey;
+			result.serial = serial;
+			{
+				std::lock_guard<std::mutex> guard(pageStoreLock);
+				result.failed = !ReadRegionPage(regionKey, result.packed);
+			}
+			std::lock_guard<std::mutex> guard(pageResultsLock);
+			pageResults.push_back(std::move(result));
+		});
+	}
+
+	// Reads the region on the calling thread instead of waiting for the paging queue, only a store
+	// operation already running is waited for. A load still queued for the region is ignored
+	bool LoadRegionNow(long long regionKey, GE_RegionPage &page) {
+		GE_ProfileScope scope(GE_PROFILER, "Region page in now");
+		std::vector<unsigned char> packed;
+		bool read;
+		{
+			std::lock_guard<std::mutex> guard(pageStoreLock);
+			read = ReadRegionPage(regionKey, packed);
+		}
+		page.loadSerial = ++pageSerial;
+		if (!read) {
+			page.state = GE_PAGE_STATE::PAGED_OUT;
+			printf("Unable to read region %lld from page store, it stays paged out\n", regionKey);
+			return false;
+		}
+		InstallRegionPage(regionKey, page, packed);
+		return true;
+	}
+
+	// Loaded regions come back compressed, they are only expanded when edited
+	void InstallLoadedRegions() {
+		std::vector<GE_PageLoadResult> results;
+		{
+			std::lock_guard<std::mutex> guard(pageResultsLock);
+			results.swap(pageResults);
+		}
+		for (GE_PageLoadResult &result : results) {
+			auto it = GE_DRAW_LIST.regionPages.find(result.regionKey);
+			if (it == GE_DRAW_LIST.regionPages.end() || (it->second.state != GE_PAGE_STATE::PAGED_OUT && it->second.state != GE_PAGE_STATE::LOADING) ||
+				(result.serial != 0 && result.serial != it->second.loadSerial)) {
+				continue;
+			}
+			GE_RegionPage &page = it->second;
+			if (result.failed) {
+				// Cells are still in the store, the region is requested again when the camera comes near
+				page.state = GE_PAGE_STATE::PAGED_OUT;
+				if (++page.failedReads == PAGE_READ_RETRIES) {
+					printf("Unable to read region %lld from page store after %d tries, it stays paged out\n", result.regionKey, PAGE_READ_RETRIES);
+				}
+				continue;
+			}
+			InstallRegionPage(result.regionKey, page, result.packed);
+		}
+	}
+
+	void InstallRegionPage(long long regionKey, GE_RegionPage &page, std::vector<unsigned char> &packed) {
+		page.packed.swap(packed);
+		page.state = GE_PAGE_STATE::COMPRESSED;
+		page.lastUsedFrame = regionFrame;
+		page.failedReads = 0;
+		regionsPagedIn++;
+
+		// Region itself and the borders of its neighbours were last built without these blocks
+		int rx, ry, rz;
+		UnpackCellKey(regionKey, rx, ry, rz);
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dz = -1; dz <= 1; dz++) {
+					GE_DRAW_LIST.dirtyRegions.insert(PackCellKey(rx + dx, ry + dy, rz + dz));
+				}
+			}
+		}
+	}
+
+	static bool IsPageResident(const GE_RegionPage &page) {
+		return page.state == GE_PAGE_STATE::EXPANDED || page.state == GE_PAGE_STATE::COMPRESSED;
+	}
+
+	// Edits need the blocks of their region in the slot map, only the editing path may block on the page store.
+	// Returns false if the region could not be read back, the edit must not touch it then
+	bool EnsureRegionExpanded(long long regionKey) {
+		auto it = GE_DRAW_LIST.regionPages.find(regionKey);
+		if (it == GE_DRAW_LIST.regionPages.end()) {
+			return true;
+		}
+		GE_RegionPage &page = it->second;
+		page.lastEditFrame = regionFrame;
+		if (!IsPageResident(page) && !LoadRegionNow(regionKey, page)) {
+			return false;
+		}
+		if (page.state == GE_PAGE_STATE::COMPRESSED) {
+			ExpandRegion(regionKey, page);
+		}
+		return true;
+	}
+
+	// Whole-scene operations (hash, export) need every region in memory, the budget is ignored until the next eviction.
+	// Returns false if a region could not be read back
+	bool PageInAllRegions() {
+		bool complete = true;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			if (!IsPageResident(entry.second)) {
+				complete = LoadRegionNow(entry.first, entry.second) && complete;
+			}
+		}
+		return complete;
+	}
+
+	void TouchRegionsAround(const vec3 &pos) {
+		// Nearest shells first, so loads close to the camera are queued before the rest
+		int cx = RegionCoord((int)lroundf(pos.x));
+		int cy = RegionCoord((int)lroundf(pos.y));
+		int cz = RegionCoord((int)lroundf(pos.z));
+		const int r = GE_OPTIONS.pageRadius;
+		for (int shell = 0; shell <= r; shell++) {
+			for (int dx = -shell; dx <= shell; dx++) {
+				for (int dy = -shell; dy <= shell; dy++) {
+					for (int dz = -shell; dz <= shell; dz++) {
+						if (std::max(abs(dx), std::max(abs(dy), abs(dz))) != shell) {
+							continue;
+						}
+						auto it = GE_DRAW_LIST.regionPages.find(PackCellKey(cx + dx, cy + dy, cz + dz));
+						if (it == GE_DRAW_LIST.regionPages.end()) {
+							continue;
+						}
+						it->second.lastUsedFrame = regionFrame;
+						if (it->second.state == GE_PAGE_STATE::PAGED_OUT && it->second.failedReads < PAGE_READ_RETRIES) {
+							RequestRegionLoad(it->first, it->second);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Loads regions near the camera and where it is heading, then evicts the least recently used
+	// ones while the scene is over budget. Never waits for the page store
+	void UpdateRegionPaging() {
+		// Camera is in world space, regions in scene space
+		vec3 camera = Vector3_Sub(MainCamera.position, Matrix4_MultiplyVectorAffine({ 0, 0, 0 }, WorldMatrix()));
+		if (regionFrame > 1) {
+			pagingVelocity = Vector3_Add(Vector3_Mul(pagingVelocity, 0.9f), Vector3_Mul(Vector3_Sub(camera, pagingLastCamera), 0.1f));
+		}
+		pagingLastCamera = camera;
+
+		TouchRegionsAround(camera);
+		vec3 predicted = Vector3_Add(camera, Vector3_Mul(pagingVelocity, (float)PAGE_PREFETCH_FRAMES));
+		if (RegionKeyOfCell((int)lroundf(predicted.x), (int)lroundf(predicted.y), (int)lroundf(predicted.z)) !=
+			RegionKeyOfCell((int)lroundf(camera.x), (int)lroundf(camera.y), (int)lroundf(camera.z))) {
+			TouchRegionsAround(predicted);
+		}
+
+		size_t budget = (size_t)(GE_OPTIONS.pageBudgetMB * 1024.0 * 1024.0);
+		size_t resident = ResidentSceneBytes();
+		if (regionFrame > 1) {
+			// Scene present before the first frame is not counted, it was never under paging
+			residentBytesPeak = std::max(residentBytesPeak, resident);
+		}
+		if (resident <= budget || pageWriteFailed) {
+			return;
+		}
+		std::vector<std::pair<unsigned long, long long>> candidates;
+		for (auto &entry : GE_DRAW_LIST.regionPages) {
+			GE_PAGE_STATE state = entry.second.state;
+			if ((state == GE_PAGE_STATE::EXPANDED || state == GE_PAGE_STATE::COMPRESSED) && entry.second.lastUsedFrame != regionFrame) {
+				candidates.push_back({ entry.second.lastUsedFrame, entry.first });
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		// Evicts a bit below the budget, so a scene right at the limit is not paged every frame
+		size_t target = budget / 10 * 9;
+		for (const std::pair<unsigned long, long long> &candidate : candidates) {
+			if (resident <= target) {
+				break;
+			}
+			GE_RegionPage &page = GE_DRAW_LIST.regionPages[candidate.second];
+			resident -= std::min(resident, ResidentRegionBytes(candidate.second, page));
+			EvictRegion(candidate.second, page);
+		}
+	}
+
+	// Runs once per frame before the region meshes are swapped in
+	void UpdateRegionStorage() {
+		InstallLoadedRegions();
+		regionFrame++;
+		CompressInactiveRegions();
+		if (GE_OPTIONS.pageBudgetMB > 0) {
+			GE_ProfileScope scope(GE_PROFILER, "Paging");
+			UpdateRegionPaging();
+		}
+	}
+
+	GE_Block MakeBlock(vec3 pos) {
+		GE_Block block;
+		block.x = (int)lroundf(pos.x);
+		block.y = (int)lroundf(pos.y);
+		block.z = (int)lroundf(pos.z);
+		return block;
+	}
+
+	bool EnsureCellExpanded(vec3 pos) {
+		GE_Block cell = MakeBlock(pos);
+		return EnsureRegionExpanded(RegionKeyOfCell(cell.x, cell.y, cell.z));
+	}
+
+	// Editing path shared by keyboard and edit scripts, returns false if nothing changed
+	bool CreateBlockAt(vec3 pos) {
+		if (!EnsureCellExpanded(pos)) {
+			return false;
+		}
+		auto inserted = GE_DRAW_LIST.blockByCell.emplace(CellKey(pos), GE_SlotHandle());
+		if (!inserted.second) {
+			LogEdit("Aborted to created block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+			return false;
+		}
+		GE_Block block = MakeBlock(pos);
+		inserted.first->second = GE_DRAW_LIST.blocks.insert(block);
+		CountRegionBlock(block.x, block.y, block.z, 1);
+		MarkRegionsDirtyAround(block.x, block.y, block.z);
+		LogEdit("Created block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+		return true;
+	}
+
+	bool RemoveBlockAt(vec3 pos) {
+		if (!EnsureCellExpanded(pos)) {
+			return false;
+		}
+		auto it = GE_DRAW_LIST.blockByCell.find(CellKey(pos));
+		if (it == GE_DRAW_LIST.blockByCell.end()) {
+			LogEdit("Unable to remove block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+			return false;
+		}
+		GE_Block *block = GE_DRAW_LIST.blocks.get(it->second);
+		MarkRegionsDirtyAround(block->x, block->y, block->z);
+		CountRegionBlock(block->x, block->y, block->z, -1);
+		GE_DRAW_LIST.blocks.remove(it->second);
+		GE_DRAW_LIST.blockByCell.erase(it);
+		LogEdit("Removed block at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+		return true;
+	}
+
+	// Negative colorType steps to the color after the current one
+	bool ChangeBlockColorAt(vec3 pos, int colorType = -1) {
+		if (!EnsureCellExpanded(pos)) {
+			return false;
+		}
+		GE_Block *block = getBlockByPos(pos);
+		if (block == nullptr) {
+			LogEdit("Aborted to change block color at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+			return false;
+		}
+		Colors::Types newColorType = colorType < 0 ? GE_COLORS.getColorTypeAfter((Colors::Types)block->colorType) : (Colors::Types)colorType;
+		if ((int)newColorType == block->colorType) {
+			return false;
+		}
+		GE_Color newColor = GE_COLORS.getColorByType(newColorType);
+		block->colorType = (unsigned char)newColorType;
+		GE_DRAW_LIST.dirtyRegions.insert(RegionKeyOfCell(block->x, block->y, block->z));
+		LogEdit("Changed color to %.2f %.2f %.2f\n", newColor.R, newColor.G, newColor.B);
+		LogEdit("Changed block color at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+		return true;
+	}
+
+	// Places a copy of the last imported mesh, returns false if nothing was imported
+	bool PlaceMeshAt(vec3 pos, int colorType = -1) {
+		if (GE_DRAW_LIST.importedMeshes.empty()) {
+			LogEdit("No imported mesh to place at %.2f %.2f %.2f\n", pos.x, pos.y, pos.z);
+			return false;
+		}
+		GE_MeshInstance instance;
+		instance.mesh = GE_DRAW_LIST.importedMeshes.back();
+		instance.position = pos;
+		if (colorType >= 0) {
+			instance.colorType = (unsigned char)colorType;
+		}
+		GE_DRAW_LIST.meshInstances.insert(instance);
+		LogEdit("Placed mesh %s at %.2f %.2f %.2f\n", instance.mesh->name.c_str(), pos.x, pos.y, pos.z);
+		return true;
+	}
+
+	// Nearest mesh instance along a ray given in camera space, invalid handle if none is hit
+	GE_SlotHandle PickMeshInstance(const vec3 &origin, const vec3 &direction, float &hitDistance) {
+		const Matrix4 matWorld = WorldMatrix();
+		GE_SlotHandle picked;
+		hitDistance = 3.4e38f;
+		size_t i = 0;
+		for (const GE_MeshInstance &instance : GE_DRAW_LIST.meshInstances) {
+			const GE_ImportedMesh &mesh = *instance.mesh;
+			// World has no rotation, so the ray only has to be moved into the space of the mesh
+			vec3 localOrigin = Vector3_Sub(origin, Matrix4_MultiplyVectorAffine(instance.position, matWorld));
+			float t;
+			unsigned int triangle;
+			if (mesh.bvh.intersectRay(localOrigin, direction, mesh.vertices, mesh.indices, t, triangle) && t < hitDistance) {
+				hitDistance = t;
+				picked = GE_DRAW_LIST.meshInstances.handleAt(i);
+			}
+			i++;
+		}
+		return picked;
+	}
+
+	bool RemoveMeshInView() {
+		float distance;
+		GE_SlotHandle handle = PickMeshInstance(MainCamera.position, MainCamera.lookDirection, distance);
+		if (!GE_DRAW_LIST.meshInstances.contains(handle)) {
+			LogEdit("No mesh in view to remove\n");
+			return false;
+		}
+		vec3 pos = GE_DRAW_LIST.meshInstances.get(handle)->position;
+		GE_DRAW_LIST.meshInstances.remove(handle);
+		LogEdit("Removed mesh at %.2f %.2f %.2f, %.2f away\n", pos.x, pos.y, pos.z, distance);
+		return true;
+	}
+
+	void CreateBlockAtSelectorPosition() {
+		CreateBlockAt(GE_DRAW_LIST.selectorBox.getPosition());
+	}
+
+	void RemoveBlockAtSelectorPosition() {
+		RemoveBlockAt(GE_DRAW_LIST.selectorBox.getPosition());
+	}
+
+	void ChangeBlockColorAtSelectorPosition() {
+		ChangeBlockColorAt(GE_DRAW_LIST.selectorBox.getPosition());
+	}
+
+	void SceneEditingHandle(SDL_Scancode scancode) {
+		//printf("SceneEditingHandle->");
+		switch (scancode) {
+		case SDL_SCANCODE_UP: {
+			//printf("Tapped SDL_SCANCODE_UP\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ 0, 0, 1 });
+			break;
+		}
+		case SDL_SCANCODE_DOWN: {
+			//printf("Tapped SDL_SCANCODE_DOWN\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ 0, 0, -1 });
+			break;
+		}
+		case SDL_SCANCODE_LEFT: {
+			//printf("Tapped SDL_SCANCODE_LEFT\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ 1, 0, 0 });
+			break;
+		}
+		case SDL_SCANCODE_RIGHT: {
+			//printf("Tapped SDL_SCANCODE_RIGHT\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ -1, 0, 0 });
+			break;
+		}
+		case SDL_SCANCODE_SPACE: {
+			//printf("Tapped SDL_SCANCODE_SPACE\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ 0, 1, 0 });
+			break;
+		}
+		case SDL_SCANCODE_X: {
+			//printf("Tapped SDL_SCANCODE_X\n");
+			GE_DRAW_LIST.selectorBox.moveBy({ 0, -1, 0 });
+			break;
+		}
+		case SDL_SCANCODE_F: {
+			//printf("Tapped SDL_SCANCODE_F\n");
+			CreateBlockAtSelectorPosition();
+			break;
+		}
+		case SDL_SCANCODE_R: {
+			//printf("Tapped SDL_SCANCODE_R\n");
+			RemoveBlockAtSelectorPosition();
+			break;
+		}
+		case SDL_SCANCODE_E: {
+			//printf("Tapped SDL_SCANCODE_E\n");
+			ChangeBlockColorAtSelectorPosition();
+			break;
+		}
+		case SDL_SCANCODE_M: {
+			PlaceMeshAt(GE_DRAW_LIST.selectorBox.getPosition());
+			break;
+		}
+		case SDL_SCANCODE_N: {
+			RemoveMeshInView();
+			break;
+		}
+		case SDL_SCANCODE_GRAVE: {
+			//printf("Tapped SDL_SCANCODE_GRAVE\n");
+			GE_CURRENT_KEYBOARD_CONTROL = Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_CAMERA_CONTROL;
+			break;
+		}
+		default:
+			printf("Tapped untreated key: %d\n", scancode);
+			break;
+		}
+	}
+
+	void CameraMovementHandle(SDL_Scancode scancode) {
+		float offset = 20.0f / (float)FRAMES_PER_SECOND;
+		//printf("CameraMovementHandle->");
+		switch (scancode) {
+			// WASD
+		case SDL_SCANCODE_W: {
+			//printf("Tapped SDL_SCANCODE_W\n");
+			MainCamera.position.z += offset;
+			break;
+		}
+		case SDL_SCANCODE_A: {
+			//printf("Tapped SDL_SCANCODE_A\n");
+			MainCamera.position.x += offset;
+			break;
+		}
+		case SDL_SCANCODE_S: {
+			//printf("Tapped SDL_SCANCODE_S\n");
+			MainCamera.position.z -= offset;
+			break;
+		}
+		case SDL_SCANCODE_D: {
+			//printf("Tapped SDL_SCANCODE_D\n");
+			MainCamera.position.x -= offset;
+			break;
+		}
+		case SDL_SCANCODE_SPACE: {
+			//printf("Tapped SDL_SCANCODE_SPACE\n");
+			MainCamera.position.y += offset;
+			break;
+		}
+		case SDL_SCANCODE_X: {
+			//printf("Tapped SDL_SCANCODE_X\n");
+			MainCamera.position.y -= offset;
+			break;
+		}
+		case SDL_SCANCODE_UP: {
+			//printf("Tapped SDL_SCANCODE_UP\n");
+			MainCamera.fXRotation -= offset;
+			break;
+		}
+		case SDL_SCANCODE_DOWN: {
+			//printf("Tapped SDL_SCANCODE_DOWN\n");
+			MainCamera.fXRotation += offset;
+			break;
+		}
+		case SDL_SCANCODE_LEFT: {
+			//printf("Tapped SDL_SCANCODE_LEFT\n");
+			MainCamera.fYRotation -= offset;
+			break;
+		}
+		case SDL_SCANCODE_RIGHT: {
+			//printf("Tapped SDL_SCANCODE_RIGHT\n");
+			MainCamera.fYRotation += offset;
+			break;
+		}
+		case SDL_SCANCODE_RIGHTBRACKET: {
+			//printf("Tapped SDL_SCANCODE_RIGHTBRACKET\n");
+			if (MainCamera.fFOV > 0 + 1)
+			{
+				MainCamera.fFOV--;
+			}
+			printf("%f\n", MainCamera.fFOV);
+			break;
+		}
+		case SDL_SCANCODE_LEFTBRACKET: {
+			//printf("Tapped SDL_SCANCODE_LEFTBRACKET\n");
+			if (MainCamera.fFOV < 180 - 1)
+			{
+				MainCamera.fFOV++;
+			}
+			printf("%f\n", MainCamera.fFOV);
+			break;
+		}
+		case SDL_SCANCODE_R: {
+			//printf("Tapped SDL_SCANCODE_R\n");
+			resetMainCamera();
+			break;
+		}
+		case SDL_SCANCODE_GRAVE: {
+			//printf("Tapped SDL_SCANCODE_GRAVE\n");
+			GE_CURRENT_KEYBOARD_CONTROL = Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_SCENE_EDITING;
+			break;
+		}
+		default:
+			printf("Tapped untreated key: %d\n", scancode);
+			break;
+		}
+	}
+
+	bool GlobalKeysHandle(SDL_Scancode scancode) {
+		// Keys available in every control mode
+		switch (scancode) {
+		case SDL_SCANCODE_F3: {
+			showProfilerOverlay = !showProfilerOverlay;
+			return true;
+		}
+		case SDL_SCANCODE_F4: {
+			WriteProfile();
+			return true;
+		}
+		case SDL_SCANCODE_F5: {
+			ExportScene(GE_OPTIONS.exportPath != nullptr ? GE_OPTIONS.exportPath : "3dge_export.obj");
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	void HandleKeyDown(SDL_Scancode scancode) {
+		long long keyNs = GE_PROFILER.now();
+		if (recordFile != NULL) {
+			fprintf(recordFile, "%lu %d\n", frameIndex, (int)scancode);
+		}
+		// Overlay and profile keys stay with the renderer, everything else changes the scene
+		if (editThread.joinable() && scancode != SDL_SCANCODE_F3 && scancode != SDL_SCANCODE_F4) {
+			PostEditCommand(scancode, keyNs);
+			return;
+		}
+		ApplyKey(scancode);
+		if (pendingKeyNs == 0) {
+			pendingKeyNs = keyNs;
+			pendingKeyApplyMs = (GE_PROFILER.now() - keyNs) / 1000000.0;
+		}
+	}
+
+	void ApplyKey(SDL_Scancode scancode) {
+		if (GlobalKeysHandle(scancode)) {
+			return;
+		}
+		switch (GE_CURRENT_KEYBOARD_CONTROL) {
+		case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_SCENE_EDITING:
+			SceneEditingHandle(scancode);
+			break;
+		case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_OBJECT_EDITING:
+			break;
+		case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_CAMERA_CONTROL:
+			CameraMovementHandle(scancode);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void RenderFrame(SDL_Renderer *renderer) {
+		if (editThread.joinable()) {
+			// Region upkeep is done by the edit thread, the frame draws its newest snapshot
+			TakeSceneSnapshots();
+		} else {
+			UpdateRegionStorage();
+
+			// Swaps in regions finished since last frame and hands new edits to workers
+			InstallFinishedRegionMeshes();
+			DispatchRegionBuilds();
+		}
+
+		//Updates properties of the screen and camera
+		updateScreenAndCameraProperties(renderer);
+
+		// Sequential mode builds geometry of this frame, pipelined mode hands this frame to the
+		// geometry thread and draws the previous one. Neither happens while the world layer is
+		// still valid, then only the selector is redrawn over it
+		PrepareFrameInput(frameInput);
+		GE_FrameGeometry *geometry = nullptr;
+		if (geometryInFlight) {
+			GE_FrameGeometry &inFlight = frameGeometry[nextFrameGeometry ^ 1];
+			geometry = IsSameWorld(inFlight.input, frameInput) ? CollectFrameGeometry() : SubmitFrameGeometry();
+		} else if (layerGeometry == nullptr || !IsSameWorld(layerGeometry->input, frameInput)) {
+			if (geometryThread.joinable()) {
+				layerGeometry = nullptr; // Its buffer takes the new frame, the layer image is shown once more
+				SubmitFrameGeometry();
+			} else {
+				geometry = &frameGeometry[0];
+				geometry->input = frameInput;
+				BuildFrameGeometry(*geometry);
+			}
+		}
+		if (geometry == nullptr && sceneTarget == NULL) {
+			return; // First frame only fills the pipeline
+		}
+
+		bool layered = true;
+		if (geometry != nullptr) {
+			// Size comes from the geometry, in pipelined mode it may be one scale change behind
+			layered = BeginSceneTarget(renderer, geometry->input.width, geometry->input.height);
+
+			//Background(Clears with color)
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+			SDL_RenderClear(renderer);
+
+			//Draws scene
+			SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+			RasterFrameGeometry(renderer, *geometry);
+			layerGeometry = layered ? geometry : nullptr;
+			layerSelectorRect = SelectorScreenRect(*geometry);
+			layerTilesValid = false;
+		} else {
+			SDL_SetRenderTarget(renderer, sceneTarget);
+		}
+		if (layerGeometry != nullptr && IsSameWorld(layerGeometry->input, frameInput)) {
+			RedrawSelectorOverLayer(renderer);
+		}
+
+		if (layered) {
+			GE_ProfileScope scope(GE_PROFILER, "Compose");
+			SDL_SetRenderTarget(renderer, NULL);
+			SDL_RenderCopy(renderer, sceneTarget, NULL, NULL);
+		}
+
+		if (showProfilerOverlay) {
+			DrawProfilerOverlay(renderer);
+		}
+
+		// Renders window
+		{
+			GE_ProfileScope scope(GE_PROFILER, "Present", &GE_FRAME_STATS.stageMs[(int)PIPELINE_STAGES::PRESENT]);
+			SDL_RenderPresent(renderer);
+		}
+		const GE_FrameInput &presented = geometry != nullptr ? geometry->input : frameInput;
+		long long presentNs = GE_PROFILER.now();
+		GE_FRAME_STATS.latencyMs = (presentNs - presented.inputNs) / 1000000.0;
+		if (pendingKeyNs != 0 && presented.keyNs == pendingKeyNs) {
+			GE_FRAME_STATS.inputLatencyMs = (presentNs - pendingKeyNs) / 1000000.0;
+			GE_FRAME_STATS.inputApplyMs = pendingKeyApplyMs;
+			pendingKeyNs = 0;
+		}
+	}
+
+	// Everything but the selector and the time stamp, equal inputs give equal world images
+	static bool IsSameWorld(const GE_FrameInput &a, const GE_FrameInput &b) {
+		if (memcmp(&a.matView, &b.matView, sizeof(Matrix4)) != 0 || memcmp(&a.matProj, &b.matProj, sizeof(Matrix4)) != 0 ||
+			memcmp(&a.lightDirection, &b.lightDirection, sizeof(vec3)) != 0 || memcmp(&a.cameraPosition, &b.cameraPosition, sizeof(vec3)) != 0 ||
+			a.width != b.width || a.height != b.height || a.style != b.style || a.gridOrder != b.gridOrder || a.regionMeshes != b.regionMeshes ||
+			a.meshInstances.size() != b.meshInstances.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.meshInstances.size(); i++) {
+			const GE_MeshInstance &ia = a.meshInstances[i], &ib = b.meshInstances[i];
+			if (ia.mesh != ib.mesh || memcmp(&ia.position, &ib.position, sizeof(vec3)) != 0 || ia.colorType != ib.colorType) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Bounds of the drawn selector with a pixel of margin for line rounding, empty when it is off screen
+	static SDL_Rect SelectorScreenRect(const GE_FrameGeometry &geometry) {
+		if (geometry.selectorClipped.empty()) {
+			return { 0, 0, 0, 0 };
+		}
+		float minX = 3.4e38f, minY = 3.4e38f, maxX = -3.4e38f, maxY = -3.4e38f;
+		for (const GE_ScreenPolygon &polygon : geometry.selectorClipped) {
+			float x0, y0, x1, y1;
+			PolygonBounds(polygon, x0, y0, x1, y1);
+			minX = std::min(minX, x0);
+			minY = std::min(minY, y0);
+			maxX = std::max(maxX, x1);
+			maxY = std::max(maxY, y1);
+		}
+		SDL_Rect rect;
+		rect.x = std::max(0, (int)minX - 1);
+		rect.y = std::max(0, (int)minY - 1);
+		rect.w = std::min(geometry.input.width, (int)maxX + 2) - rect.x;
+		rect.h = std::min(geometry.input.height, (int)maxY + 2) - rect.y;
+		return rect;
+	}
+
+	// Layer target must be bound. Redraws the old and new selector rectangles when the selector changed
+	void RedrawSelectorOverLayer(SDL_Renderer *renderer) {
+		GE_FrameGeometry &geometry = *layerGeometry;
+		std::vector<GE_ScreenPolygon> previous = geometry.selectorClipped;
+		geometry.input.selectorBox = frameInput.selectorBox;
+		BuildSelectorGeometry(geometry);
+		if (std::equal(previous.begin(), previous.end(), geometry.selectorClipped.begin(), geometry.selectorClipped.end(), IsSamePolygon)) {
+			return;
+		}
+
+		SDL_Rect rect = SelectorScreenRect(geometry);
+		SDL_Rect dirty = layerSelectorRect;
+		if (dirty.w <= 0 || dirty.h <= 0) {
+			dirty = rect;
+		} else if (rect.w > 0 && rect.h > 0) {
+			int right = std::max(dirty.x + dirty.w, rect.x + rect.w);
+			int bottom = std::max(dirty.y + dirty.h, rect.y + rect.h);
+			dirty.x = std::min(dirty.x, rect.x);
+			dirty.y = std::min(dirty.y, rect.y);
+			dirty.w = right - dirty.x;
+			dirty.h = bottom - dirty.y;
+		}
+		layerSelectorRect = rect;
+		if (dirty.w <= 0 || dirty.h <= 0) {
+			return;
+		}
+
+		GE_ProfileScope scope(GE_PROFILER, "Selector redraw", &GE_FRAME_STATS.stageMs[(int)PIPELINE_STAGES::RASTER]);
+		if (!layerTilesValid) {
+			BuildLayerTiles(geometry);
+		}
+		layerRedrawPolygons.clear();
+		for (int ty = dirty.y / LAYER_TILE_SIZE; ty <= (dirty.y + dirty.h - 1) / LAYER_TILE_SIZE && ty < layerTilesY; ty++) {
+			for (int tx = dirty.x / LAYER_TILE_SIZE; tx <= (dirty.x + dirty.w - 1) / LAYER_TILE_SIZE && tx < layerTilesX; tx++) {
+				int tile = ty * layerTilesX + tx;
+				layerRedrawPolygons.insert(layerRedrawPolygons.end(), layerTilePolygons.begin() + layerTileStart[tile], layerTilePolygons.begin() + layerTileStart[tile + 1]);
+			}
+		}
+		// Triangles spanning several tiles are listed in each of them
+		std::sort(layerRedrawPolygons.begin(), layerRedrawPolygons.end());
+		layerRedrawPolygons.erase(std::unique(layerRedrawPolygons.begin(), layerRedrawPolygons.end()), layerRedrawPolygons.end());
+
+		SDL_RenderSetClipRect(renderer, &dirty);
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+		SDL_RenderFillRect(renderer, &dirty);
+		GE_FRAME_STATS.trianglesDrawn += RasterLayers(renderer, geometry, &layerRedrawPolygons);
+		SDL_RenderSetClipRect(renderer, NULL);
+	}
+
+	// Counts polygons per tile first, so the lists go into one vector
+	void BuildLayerTiles(const GE_FrameGeometry &geometry) {
+		GE_ProfileScope scope(GE_PROFILER, "Layer tiles");
+		layerTilesX = (geometry.input.width + LAYER_TILE_SIZE - 1) / LAYER_TILE_SIZE;
+		layerTilesY = (geometry.input.height + LAYER_TILE_SIZE - 1) / LAYER_TILE_SIZE;
+		const std::vector<GE_ScreenPolygon> &world = geometry.polygonsClipped;
+		auto tileRange = [&](const GE_ScreenPolygon &polygon, int &x0, int &y0, int &x1, int &y1) {
+			float minX, minY, maxX, maxY;
+			PolygonBounds(polygon, minX, minY, maxX, maxY);
+			x0 = std::max(0, (int)minX / LAYER_TILE_SIZE);
+			y0 = std::max(0, (int)minY / LAYER_TILE_SIZE);
+			x1 = std::min(layerTilesX - 1, (int)maxX / LAYER_TILE_SIZE);
+			y1 = std::min(layerTilesY - 1, (int)maxY / LAYER_TILE_SIZE);
+		};
+
+		layerTileStart.assign(layerTilesX * layerTilesY + 1, 0);
+		int x0, y0, x1, y1;
+		for (const GE_ScreenPolygon &polygon : world) {
+			tileRange(polygon, x0, y0, x1, y1);
+			for (int ty = y0; ty <= y1; ty++) {
+				for (int tx = x0; tx <= x1; tx++) {
+					layerTileStart[ty * layerTilesX + tx + 1]++;
+				}
+			}
+		}
+		for (size_t i = 1; i < layerTileStart.size(); i++) {
+			layerTileStart[i] += layerTileStart[i - 1];
+		}
+		layerTilePolygons.resize(layerTileStart.back());
+		std::vector<unsigned int> fill(layerTileStart.begin(), layerTileStart.end() - 1);
+		for (size_t i = 0; i < world.size(); i++) {
+			tileRange(world[i], x0, y0, x1, y1);
+			for (int ty = y0; ty <= y1; ty++) {
+				for (int tx = x0; tx <= x1; tx++) {
+					layerTilePolygons[fill[ty * layerTilesX + tx]++] = (unsigned int)i;
+				}
+			}
+		}
+		layerTilesValid = true;
+	}
+
+	// Binds the layer target, recreated when the size changes. Output gets it stretched over when it is smaller
+	bool BeginSceneTarget(SDL_Renderer *renderer, int width, int height) {
+		if (sceneTarget == NULL || sceneTargetWidth != width || sceneTargetHeight != height) {
+			ReleaseSceneTarget();
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+			sceneTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+			if (sceneTarget == NULL) {
+				printf("Error creating render target! SDL_Error: %s\n", SDL_GetError());
+				return false;
+			}
+			sceneTargetWidth = width;
+			sceneTargetHeight = height;
+		}
+		SDL_SetRenderTarget(renderer, sceneTarget);
+		return true;
+	}
+
+	// Must be called before the renderer owning the target is destroyed
+	void ReleaseSceneTarget() {
+		if (sceneTarget != NULL) {
+			SDL_DestroyTexture(sceneTarget);
+			sceneTarget = NULL;
+		}
+		layerGeometry = nullptr;
+	}
+
+	void UpdateRenderScale() {
+		// Waits for the smoothed frame time to follow the last change, so the scale does not oscillate
+		const int settleFrames = 15;
+		if (++framesSinceScaleChange < settleFrames || GE_FRAME_STATS_SMOOTHED.frameMs <= 0) {
+			return;
+		}
+		double budgetMs = GE_OPTIONS.frameBudgetMs > 0 ? GE_OPTIONS.frameBudgetMs : 1000.0 / FRAMES_PER_SECOND;
+		double frameMs = GE_FRAME_STATS_SMOOTHED.frameMs;
+		float scale = renderScale;
+		if (frameMs > budgetMs) {
+			// Fill cost grows with the square of the scale
+			scale = renderScale * (float)sqrt(budgetMs / frameMs);
+		} else if (frameMs < budgetMs * 0.7) {
+			scale = renderScale + 0.05f;
+		}
+		scale = std::min(GE_OPTIONS.renderScaleMax, std::max(GE_OPTIONS.renderScaleMin, roundf(scale * 20.0f) / 20.0f));
+		if (scale != renderScale) {
+			renderScale = scale;
+			framesSinceScaleChange = 0;
+		}
+	}
+
+	// Pipelined mode: queues hold at most one frame each way, so drawn frame is never more than one frame old
+	void StartGeometryThread() {
+		if (geometryThread.joinable()) {
+			return;
+		}
+		geometryThread = std::thread([this]() {
+			GE_PROFILER.setThreadName("geometry");
+			GE_FrameGeometry *geometry;
+			while (geometryJobs.pop(geometry)) {
+				BuildFrameGeometry(*geometry);
+				if (!geometryDone.push(geometry)) {
+					break;
+				}
+			}
+		});
+		printf("Started geometry thread!\n");
+	}
+
+	void StopGeometryThread() {
+		if (!geometryThread.joinable()) {
+			return;
+		}
+		geometryJobs.close();
+		geometryDone.close();
+		geometryThread.join();
+		geometryJobs.reset();
+		geometryDone.reset();
+		geometryInFlight = false;
+	}
+
+	// Hands input of this frame to the geometry thread, returns geometry of the previous frame
+	// or nullptr when nothing was in flight yet
+	GE_FrameGeometry *SubmitFrameGeometry() {
+		// Other buffer was drawn last frame, so the geometry thread is done with it
+		GE_FrameGeometry &next = frameGeometry[nextFrameGeometry];
+		nextFrameGeometry ^= 1;
+		next.input = frameInput;
+
+		GE_FrameGeometry *previous = nullptr;
+		bool hadFrameInFlight = geometryInFlight;
+		geometryJobs.push(&next);
+		geometryInFlight = true;
+		if (hadFrameInFlight) {
+			geometryDone.pop(previous);
+		}
+		return previous;
+	}
+
+	// Waits for the frame in flight without submitting a new one
+	GE_FrameGeometry *CollectFrameGeometry() {
+		GE_FrameGeometry *previous = nullptr;
+		geometryDone.pop(previous);
+		geometryInFlight = false;
+		return previous;
+	}
+
+	// Taken on the edit thread, the renderer reads it instead of GE_DRAW_LIST and MainCamera
+	std::shared_ptr<GE_SceneSnapshot> MakeSceneSnapshot() {
+		std::shared_ptr<GE_SceneSnapshot> scene = std::make_shared<GE_SceneSnapshot>();
+		MainCamera.lookDirection = CameraLookDirection(MainCamera); // Picking meshes in view reads it
+		scene->camera = MainCamera;
+		scene->selectorBox = GE_DRAW_LIST.selectorBox;
+		CollectRegionMeshes(scene->regionMeshes);
+		scene->meshInstances.assign(GE_DRAW_LIST.meshInstances.begin(), GE_DRAW_LIST.meshInstances.end());
+		if (GE_OPTIONS.pageBudgetMB > 0) {
+			scene->residentMB = ResidentSceneBytes() / (1024.0 * 1024.0);
+			scene->regionsPagedOut = CountPagedOutRegions();
+		}
+		return scene;
+	}
+
+	// Synced mode does region upkeep only when asked by a sync command, headless replay uses it
+	void StartEditThread(bool synced) {
+		if (editThread.joinable()) {
+			return;
+		}
+		editThreadStop = false;
+		sceneSnapshot = MakeSceneSnapshot(); // Renderer starts from the loaded scene
+		editThread = std::thread([this, synced]() {
+			GE_PROFILER.setThreadName("edit");
+			unsigned long version = 0;
+			unsigned long upkeepFrame = framesRendered.load(std::memory_order_acquire);
+			std::shared_ptr<const GE_SceneSnapshot> unpublished; // Snapshot queue was full, pushed again on the next pass
+			long long keyNs = 0, appliedNs = 0;
+			unsigned long syncSerial = 0;
+			while (!editThreadStop.load(std::memory_order_acquire)) {
+				bool changed = false;
+				GE_EditCommand command;
+				while (editCommands.tryPop(command)) {
+					changed = true;
+					if (command.scancode == EDIT_SYNC) {
+						// Same steps as a sequential headless frame, so a replay ends in the same scene
+						FlushRegionBuilds();
+						UpdateRegionStorage();
+						InstallFinishedRegionMeshes();
+						DispatchRegionBuilds();
+						syncSerial = command.serial;
+						break; // Published before any later key is applied
+					}
+					ApplyKey((SDL_Scancode)command.scancode);
+					keyNs = keyNs != 0 ? keyNs : command.keyNs;
+					appliedNs = GE_PROFILER.now();
+				}
+				if (!synced) {
+					unsigned long frames = framesRendered.load(std::memory_order_acquire);
+					if (frames != upkeepFrame) {
+						upkeepFrame = frames;
+						UpdateRegionStorage();
+						changed |= GE_OPTIONS.pageBudgetMB > 0; // Paging moves regions in and out
+					}
+					changed |= InstallFinishedRegionMeshes();
+					DispatchRegionBuilds();
+				}
+
+				if (changed) {
+					// Replaces a snapshot still waiting, its oldest key is carried over
+					std::shared_ptr<GE_SceneSnapshot> scene = MakeSceneSnapshot();
+					scene->version = ++version;
+					scene->keyNs = keyNs;
+					scene->appliedNs = appliedNs;
+					scene->syncSerial = syncSerial;
+					unpublished = scene;
+				}
+				if (unpublished != nullptr && sceneSnapshots.tryPush(std::move(unpublished))) {
+					keyNs = 0;
+				}
+				if (!changed) {
+					std::this_thread::sleep_for(std::chrono::microseconds(200));
+				}
+			}
+		});
+		printf("Started edit thread!\n");
+	}
+
+	void StopEditThread() {
+		if (!editThread.joinable()) {
+			return;
+		}
+		editThreadStop = true;
+		editThread.join();
+		// Keys posted after its last pass are applied here, nothing typed gets lost
+		GE_EditCommand command;
+		while (editCommands.tryPop(command)) {
+			if (command.scancode != EDIT_SYNC) {
+				ApplyKey((SDL_Scancode)command.scancode);
+			}
+		}
+		std::shared_ptr<const GE_SceneSnapshot> scene;
+		while (sceneSnapshots.tryPop(scene)) {
+		}
+		sceneSnapshot = nullptr;
+		pendingKeyNs = 0;
+	}
+
+	unsigned long PostEditCommand(int scancode, long long keyNs) {
+		GE_EditCommand command;
+		command.scancode = scancode;
+		command.keyNs = keyNs;
+		command.serial = ++editSerial;
+		// The edit thread empties the queue on every pass, a full one is only waited out that long
+		while (!editCommands.tryPush(command)) {
+			std::this_thread::yield();
+		}
+		return command.serial;
+	}
+
+	// Moves the renderer to the newest published snapshot, returns false if nothing new was published
+	bool TakeSceneSnapshots() {
+		std::shared_ptr<const GE_SceneSnapshot> scene;
+		bool taken = false;
+		while (sceneSnapshots.tryPop(scene)) {
+			if (scene->keyNs != 0 && pendingKeyNs == 0) {
+				pendingKeyNs = scene->keyNs;
+				pendingKeyApplyMs = (scene->appliedNs - scene->keyNs) / 1000000.0;
+			}
+			sceneSnapshot = std::move(scene);
+			taken = true;
+		}
+		return taken;
+	}
+
+	// Waits until keys posted so far are applied and their region builds installed
+	void SyncEditThread() {
+		unsigned long serial = PostEditCommand(EDIT_SYNC, 0);
+		while (sceneSnapshot->syncSerial != serial) {
+			if (!TakeSceneSnapshots()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void StartRenderLoop() {
+		SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0); // SDL_RENDERER_ACCELERATED is Default
+		Uint32 start;
+		SDL_Event windowEvent;
+
+		if (GE_OPTIONS.recordPath != nullptr) {
+			recordFile = fopen(GE_OPTIONS.recordPath, "w");
+			if (recordFile != NULL) {
+				fprintf(recordFile, "3DGE_INPUT 1 %d %d\n", WIDTH, HEIGHT);
+				printf("Recording input to %s\n", GE_OPTIONS.recordPath);
+			} else {
+				printf("Unable to record input to %s\n", GE_OPTIONS.recordPath);
+			}
+		}
+		if (GE_OPTIONS.pipelined) {
+			StartGeometryThread();
+		}
+		if (GE_OPTIONS.editThread) {
+			StartEditThread(false);
+		}
+		adaptiveRenderScale = GE_OPTIONS.renderScale <= 0;
+		if (adaptiveRenderScale) {
+			renderScale = GE_OPTIONS.renderScaleMax;
+		}
+
+		while (isRunning)
+		{
+			GE_PROFILER.beginFrame();
+			GE_FRAME_STATS = GE_FrameStats();
+			long long frameStart = GE_PROFILER.now();
+
+			while (SDL_PollEvent(&windowEvent))
+			{
+				if (windowEvent.type == SDL_QUIT)
+				{
+					isRunning = false;
+				}
+
+				if (windowEvent.type == SDL_KEYDOWN) {
+					HandleKeyDown(windowEvent.key.keysym.scancode);
+				}
+
+				// Some backends lose target contents, the world layer has to be drawn again
+				if (windowEvent.type == SDL_RENDER_TARGETS_RESET) {
+					layerGeometry = nullptr;
+				}
+			}
+			start = SDL_GetTicks();
+
+			RenderFrame(renderer);
+			framesRendered.fetch_add(1, std::memory_order_release);
+			GE_FRAME_STATS.frameMs = (GE_PROFILER.now() - frameStart) / 1000000.0;
+			FinishFrameStats();
+			if (adaptiveRenderScale) {
+				UpdateRenderScale();
+			}
+			frameIndex++;
+
+			Uint32 ticks = SDL_GetTicks();
+			if (1000 / FRAMES_PER_SECOND > ticks - start) {
+				SDL_Delay(1000 / FRAMES_PER_SECOND - (ticks - start));
+			}
+		}
+		StopEditThread();
+		StopGeometryThread();
+		ReleaseSceneTarget();
+		SDL_DestroyRenderer(renderer);
+
+		if (recordFile != NULL) {
+			fprintf(recordFile, "end %lu\n", frameIndex);
+			fclose(recordFile);
+			recordFile = NULL;
+			printf("Recorded %lu frames to %s\n", frameIndex, GE_OPTIONS.recordPath);
+		}
+
+		if (GE_OPTIONS.profilePrefix != nullptr) {
+			WriteProfile();
+		}
+	}
+
+	SDL_Renderer *CreateHeadlessRenderer(int width, int height) {
+		if (headlessSurface != NULL) {
+			SDL_FreeSurface(headlessSurface);
+		}
+		headlessSurface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+		if (headlessSurface == NULL) {
+			printf("Error creating offscreen surface! SDL_Error: %s\n", SDL_GetError());
+			return NULL;
+		}
+		return SDL_CreateSoftwareRenderer(headlessSurface);
+	}
+
+	unsigned long long HashScene() {
+		PageInAllRegions();
+		// FNV-1a over everything edits and camera movement can change
+		unsigned long long hash = 14695981039346656037ull;
+		auto mix = [&](const void *data, size_t size) {
+			const unsigned char *bytes = (const unsigned char *)data;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		// Blocks are summed, so the hash does not depend on their order in storage (paging reorders them)
+		unsigned long long blockSum = 0;
+		ForEachSceneBlock([&](int x, int y, int z, unsigned char colorType) {
+			unsigned long long blockHash = 14695981039346656037ull;
+			std::swap(hash, blockHash);
+			mix(&x, sizeof(x));
+			mix(&y, sizeof(y));
+			mix(&z, sizeof(z));
+			mix(&colorType, sizeof(colorType));
+			std::swap(hash, blockHash);
+			blockSum += blockHash;
+		});
+		mix(&blockSum, sizeof(blockSum));
+		vec3 selectorPos = GE_DRAW_LIST.selectorBox.getPosition();
+		mix(&selectorPos, sizeof(selectorPos));
+		mix(&MainCamera.position, sizeof(MainCamera.position));
+		mix(&MainCamera.fXRotation, sizeof(MainCamera.fXRotation));
+		mix(&MainCamera.fYRotation, sizeof(MainCamera.fYRotation));
+		mix(&MainCamera.fFOV, sizeof(MainCamera.fFOV));
+		for (const GE_MeshInstance &instance : GE_DRAW_LIST.meshInstances) {
+			mix(&instance.position, sizeof(instance.position));
+			mix(&instance.colorType, sizeof(instance.colorType));
+		}
+		return hash;
+	}
+
+	void ClearScene() {
+		regionBuildPool.waitIdle();
+		InstallFinishedRegionMeshes();
+		GE_DRAW_LIST.blocks = GE_SlotMap<GE_Block>();
+		std::unordered_map<long long, GE_SlotHandle>().swap(GE_DRAW_LIST.blockByCell);
+		std::unordered_map<long long, GE_Region>().swap(GE_DRAW_LIST.regions);
+		std::unordered_set<long long>().swap(GE_DRAW_LIST.dirtyRegions);
+		pagingPool.waitIdle();
+		pageResults.clear();
+		pageWritesPending.clear();
+		std::unordered_map<long long, GE_RegionPage>().swap(GE_DRAW_LIST.regionPages);
+		GE_DRAW_LIST.meshInstances = GE_SlotMap<GE_MeshInstance>();
+	}
+
+	void BuildScene(std::vector<vec3> &positions) {
+		// Bulk counterpart of CreateBlockAtSelectorPosition, waits until all touched regions are built
+		GE_DRAW_LIST.blocks.reserve(GE_DRAW_LIST.blocks.size() + positions.size());
+		GE_DRAW_LIST.blockByCell.reserve(GE_DRAW_LIST.blocks.size() + positions.size());
+		long long lastRegionKey = -1;
+		long long lastPageKey = -1;
+		GE_RegionPage *page = nullptr;
+		for (vec3 &pos : positions) {
+			auto inserted = GE_DRAW_LIST.blockByCell.emplace(CellKey(pos), GE_SlotHandle());
+			if (inserted.second) {
+				GE_Block block = MakeBlock(pos);
+				inserted.first->second = GE_DRAW_LIST.blocks.insert(block);
+				// Neighbouring blocks mostly share regions, skip the set when nothing changed
+				long long regionKey = RegionKeyOfCell(block.x, block.y, block.z);
+				if (regionKey != lastPageKey) {
+					page = &GE_DRAW_LIST.regionPages[regionKey];
+					lastPageKey = regionKey;
+				}
+				page->blockCount++;
+				bool interior = RegionKeyOfCell(block.x - 1, block.y - 1, block.z - 1) == regionKey && RegionKeyOfCell(block.x + 1, block.y + 1, block.z + 1) == regionKey;
+				if (!interior) {
+					MarkRegionsDirtyAround(block.x, block.y, block.z);
+				} else if (regionKey != lastRegionKey) {
+					GE_DRAW_LIST.dirtyRegions.insert(regionKey);
+					lastRegionKey = regionKey;
+				}
+			}
+		}
+		FlushRegionBuilds();
+	}
+
+	std::vector<vec3> GenerateBenchmarkScene(const char *scene, unsigned long targetBlocks) {
+		std::vector<vec3> positions;
+		if (strcmp(scene, "solid") == 0) {
+			int side = std::max(1, (int)lround(cbrt((double)targetBlocks)));
+			for (int x = 0; x < side; x++) {
+				for (int y = 0; y < side; y++) {
+					for (int z = 0; z < side; z++) {
+						positions.push_back({ (float)x, (float)y, (float)z });
+					}
+				}
+			}
+		} else if (strcmp(scene, "shell") == 0) {
+			// Surface of a cube has about 6 * side^2 blocks
+			int side = std::max(3, (int)lround(sqrt(targetBlocks / 6.0)) + 1);
+			for (int x = 0; x < side; x++) {
+				for (int y = 0; y < side; y++) {
+					for (int z = 0; z < side; z++) {
+						if (x == 0 || y == 0 || z == 0 || x == side - 1 || y == side - 1 || z == side - 1) {
+							positions.push_back({ (float)x, (float)y, (float)z });
+						}
+					}
+				}
+			}
+		} else if (strcmp(scene, "terrain") == 0) {
+			int side = std::max(1, (int)lround(sqrt((double)targetBlocks)));
+			for (int x = 0; x < side; x++) {
+				for (int z = 0; z < side; z++) {
+					positions.push_back({ (float)x, 0.0f, (float)z });
+				}
+			}
+		} else if (strcmp(scene, "sparse") == 0) {
+			// 5% of a cubic volume, fixed seed so block counts match between runs
+			int side = std::max(1, (int)lround(cbrt(targetBlocks / 0.05)));
+			std::unordered_set<long long> taken;
+			unsigned long long seed = 0x3D6E;
+			while (positions.size() < targetBlocks && positions.size() < (size_t)side * side * side) {
+				seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+				vec3 pos = { (float)((seed >> 33) % side), (float)((seed >> 43) % side), (float)((seed >> 53) % side) };
+				if (taken.insert(CellKey(pos)).second) {
+					positions.push_back(pos);
+				}
+			}
+		}
+		return positions;
+	}
+
+	void AimCameraAtScene() {
+		if (GE_DRAW_LIST.regionPages.empty()) {
+			resetMainCamera();
+			return;
+		}
+		vec3 minPos = { 3.4e38f, 3.4e38f, 3.4e38f };
+		vec3 maxPos = { -3.4e38f, -3.4e38f, -3.4e38f };
+		ForEachSceneBlock([&](int x, int y, int z, unsigned char) {
+			vec3 p = { (float)x, (float)y, (float)z };
+			minPos = { std::min(minPos.x, p.x), std::min(minPos.y, p.y), std::min(minPos.z, p.z) };
+			maxPos = { std::max(maxPos.x, p.x), std::max(maxPos.y, p.y), std::max(maxPos.z, p.z) };
+		});
+		if (minPos.x > maxPos.x) {
+			resetMainCamera(); // Everything is paged out
+			return;
+		}
+		vec3 center = Vector3_Add(minPos, maxPos);
+		center = Vector3_Mul(center, 0.5f);
+		vec3 size = Vector3_Sub(maxPos, minPos);
+		float extent = std::max(size.x, std::max(size.y, size.z)) * 0.9f + 3.0f;
+		resetMainCamera();
+		vec3 offset = { -extent, extent, -extent };
+		MainCamera.position = Vector3_Add(center, offset);
+
+		// Inverse of the look direction built in PrepareFrameInput from X and Y rotations
+		vec3 toCenter = Vector3_Sub(center, MainCamera.position);
+		vec3 d = Vector3_Normalize(toCenter);
+		MainCamera.fXRotation = asinf(-d.y);
+		MainCamera.fYRotation = atan2f(-d.x, d.z);
+	}
+
+	struct GE_SceneBenchmarkResult {
+		std::string scene;
+		unsigned long targetBlocks = 0;
+		unsigned long blocks = 0;
+		double buildMs = 0;
+		double frameMsAvg = 0;
+		double frameMsMin = 0;
+		double createMs = 0;
+		double removeMs = 0;
+		double residentMB = 0; // Estimated scene data, see ResidentSceneBytes
+		double selectorMs = 0; // Frame after a selector step with the camera still
+	};
+
+	std::vector<GE_SceneBenchmarkResult> ReadSceneBenchmarkCSV(const char *path) {
+		std::vector<GE_SceneBenchmarkResult> results;
+		FILE *f = fopen(path, "r");
+		if (f == NULL) {
+			return results;
+		}
+		char line[512];
+		while (fgets(line, sizeof(line), f) != NULL) {
+			GE_SceneBenchmarkResult r;
+			char scene[64];
+			// Baselines written before selector_ms was added have 9 columns
+			if (sscanf(line, "%63[^,],%lu,%lu,%lf,%lf,%lf,%lf,%lf,%lf,%lf", scene, &r.targetBlocks, &r.blocks, &r.buildMs,
+				&r.frameMsAvg, &r.frameMsMin, &r.createMs, &r.removeMs, &r.residentMB, &r.selectorMs) >= 9) {
+				r.scene = scene;
+				results.push_back(r);
+			}
+		}
+		fclose(f);
+		return results;
+	}
+
+	int RunSceneBenchmarks() {
+		const char *scenes[] = { "solid", "shell", "terrain", "sparse" };
+		const int editRepeats = 5;
+		GE_LOG_EDITS = false;
+
+		SDL_Renderer *renderer = CreateHeadlessRenderer(WIDTH, HEIGHT);
+		if (renderer == NULL) {
+			return 1;
+		}
+
+		if (GE_OPTIONS.pipelined) {
+			StartGeometryThread();
+		}
+
+		std::vector<GE_SceneBenchmarkResult> results;
+		for (const char *scene : scenes) {
+			for (unsigned long targetBlocks = 100; targetBlocks <= GE_OPTIONS.benchMaxBlocks; targetBlocks *= 10) {
+				ClearScene();
+				GE_SceneBenchmarkResult r;
+				r.scene = scene;
+				r.targetBlocks = targetBlocks;
+
+				std::vector<vec3> positions = GenerateBenchmarkScene(scene, targetBlocks);
+				long long start = GE_PROFILER.now();
+				BuildScene(positions);
+				r.buildMs = (GE_PROFILER.now() - start) / 1000000.0;
+				CompressInactiveRegions(true);
+				r.blocks = SceneBlockCount();
+				std::vector<vec3>().swap(positions);
+
+				AimCameraAtScene();
+				r.frameMsMin = 1e30;
+				for (int i = 0; i < GE_OPTIONS.benchFrames; i++) {
+					GE_FRAME_STATS = GE_FrameStats();
+					start = GE_PROFILER.now();
+					RenderFrame(renderer);
+					double frameMs = (GE_PROFILER.now() - start) / 1000000.0;
+					r.frameMsAvg += frameMs / GE_OPTIONS.benchFrames;
+					r.frameMsMin = std::min(r.frameMsMin, frameMs);
+				}
+				// Bytes of the scene itself, the process never gives back the peak of an earlier scene
+				r.residentMB = ResidentSceneBytes() / (1024.0 * 1024.0);
+
+				// Selector steps back and forth, the world layer stays valid. First step is not timed, it indexes the layer
+				for (int i = -1; i < GE_OPTIONS.benchFrames; i++) {
+					GE_DRAW_LIST.selectorBox.moveBy({ i % 2 == 0 ? 1.0f : -1.0f, 0, 0 });
+					if (i < 0) {
+						RenderFrame(renderer);
+						continue;
+					}
+					GE_FRAME_STATS = GE_FrameStats();
+					start = GE_PROFILER.now();
+					RenderFrame(renderer);
+					r.selectorMs += (GE_PROFILER.now() - start) / 1000000.0 / GE_OPTIONS.benchFrames;
+				}
+
+				// Removes a block and puts it back, so the scene keeps its size
+				vec3 editPos;
+				for (int i = 0; i < editRepeats && AnySceneBlockPosition(editPos); i++) {
+					GE_DRAW_LIST.selectorBox.moveTo(editPos);
+					start = GE_PROFILER.now();
+					RemoveBlockAtSelectorPosition();
+					r.removeMs += (GE_PROFILER.now() - start) / 1000000.0 / editRepeats;
+					start = GE_PROFILER.now();
+					CreateBlockAtSelectorPosition();
+					r.createMs += (GE_PROFILER.now() - start) / 1000000.0 / editRepeats;
+				}
+
+				printf("%-8s %9lu blocks: build %10.2f ms, frame %8.3f ms, selector %8.3f ms, create %8.4f ms, remove %8.4f ms, resident %8.1f MB est.\n",
+					scene, r.blocks, r.buildMs, r.frameMsAvg, r.selectorMs, r.createMs, r.removeMs, r.residentMB);
+				results.push_back(r);
+			}
+		}
+		StopGeometryThread();
+		ClearScene();
+		ReleaseSceneTarget();
+		SDL_DestroyRenderer(renderer);
+
+		if (GE_OPTIONS.benchScenesPath != nullptr) {
+			FILE *f = strcmp(GE_OPTIONS.benchScenesPath, "-") == 0 ? stdout : fopen(GE_OPTIONS.benchScenesPath, "w");
+			if (f == NULL) {
+				printf("Unable to write benchmark results to %s\n", GE_OPTIONS.benchScenesPath);
+				return 1;
+			}
+			fprintf(f, "scene,target_blocks,blocks,build_ms,frame_ms_avg,frame_ms_min,create_ms,remove_ms,resident_mb,selector_ms\n");
+			for (GE_SceneBenchmarkResult &r : results) {
+				fprintf(f, "%s,%lu,%lu,%.4f,%.4f,%.4f,%.5f,%.5f,%.2f,%.4f\n", r.scene.c_str(), r.targetBlocks, r.blocks, r.buildMs,
+					r.frameMsAvg, r.frameMsMin, r.createMs, r.removeMs, r.residentMB, r.selectorMs);
+			}
+			if (f != stdout) {
+				fclose(f);
+			}
+		}
+
+		if (GE_OPTIONS.benchBaselinePath == nullptr) {
+			return 0;
+		}
+
+		// Compares against stored baseline, small absolute differences are treated as noise
+		std::vector<GE_SceneBenchmarkResult> baseline = ReadSceneBenchmarkCSV(GE_OPTIONS.benchBaselinePath);
+		if (baseline.empty()) {
+			printf("Unable to read benchmark baseline %s\n", GE_OPTIONS.benchBaselinePath);
+			return 1;
+		}
+		int regressions = 0;
+		auto check = [&](GE_SceneBenchmarkResult &r, const char *metric, double current, double base, double noise) {
+			if (current > base * (1.0 + GE_OPTIONS.benchThreshold) && current - base > noise) {
+				printf("REGRESSION %s %lu blocks: %s %.4f -> %.4f (+%.1f%%)\n", r.scene.c_str(), r.blocks, metric, base, current,
+					(current / base - 1.0) * 100.0);
+				regressions++;
+			}
+		};
+		for (GE_SceneBenchmarkResult &r : results) {
+			for (GE_SceneBenchmarkResult &b : baseline) {
+				if (b.scene == r.scene && b.blocks == r.blocks) {
+					check(r, "frame_ms_avg", r.frameMsAvg, b.frameMsAvg, 0.05);
+					check(r, "create_ms", r.createMs, b.createMs, 0.005);
+					check(r, "remove_ms", r.removeMs, b.removeMs, 0.005);
+					check(r, "resident_mb", r.residentMB, b.residentMB, 1.0);
+					if (b.selectorMs > 0) {
+						check(r, "selector_ms", r.selectorMs, b.selectorMs, 0.05);
+					}
+				}
+			}
+		}
+		printf("%d regressions against %s (threshold %.0f%%)\n", regressions, GE_OPTIONS.benchBaselinePath, GE_OPTIONS.benchThreshold * 100.0);
+		return regressions > 0 ? 1 : 0;
+	}
+
+	template <typename F>
+	double MeasureNsPerOp(unsigned long opsPerRun, F run) {
+		// Repeats the batch until at least 100 ms are spent, after one warm-up run
+		run();
+		unsigned long runs = 0;
+		long long start = GE_PROFILER.now();
+		long long elapsed = 0;
+		do {
+			run();
+			runs++;
+			elapsed = GE_PROFILER.now() - start;
+		} while (elapsed < 100000000);
+		return (double)elapsed / ((double)runs * opsPerRun);
+	}
+
+	int RunKernelBenchmarks() {
+		struct KernelResult {
+			const char *kernel;
+			unsigned long batch;
+			double nsPerOp;
+		};
+		std::vector<KernelResult> results;
+		float sink = 0; // Keeps results alive
+		unsigned long long seed = 0x3D6E;
+		auto random = [&](float lo, float hi) {
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+			return lo + (hi - lo) * (float)((seed >> 40) & 0xFFFFFF) / (float)0xFFFFFF;
+		};
+		auto report = [&](const char *kernel, unsigned long batch, double nsPerOp) {
+			printf("%-28s batch %7lu: %10.2f ns/op, %8.2f Mops/s\n", kernel, batch, nsPerOp, 1000.0 / nsPerOp);
+			results.push_back({ kernel, batch, nsPerOp });
+		};
+
+		vec3 upVector = { 0, 1, 0 };
+		vec3 target = { 0.3f, -0.4f, 1.0f };
+		vec3 eye = { 3, 4, -2 };
+		Matrix4 matCamera = Matrix4_PointAt(eye, target, upVector);
+		Matrix4 matView = Matrix4_QuickInverse(matCamera);
+		Matrix4 proj = Matrix4_MakeProjection(90.0f, 0.75f, 0.1f, 1000.0f);
+
+		const unsigned long vertexBatches[] = { 1024, 65536 };
+		for (unsigned long batch : vertexBatches) {
+			std::vector<vec3> in(batch), out(batch);
+			for (vec3 &v : in) {
+				v = { random(-50, 50), random(-50, 50), random(1, 100) };
+			}
+			report("Matrix4_MultiplyVector", batch, MeasureNsPerOp(batch, [&]() {
+				for (unsigned long i = 0; i < batch; i++) {
+					out[i] = Matrix4_MultiplyVector(in[i], proj);
+				}
+				sink += out[batch / 2].x;
+			}));
+			report("Matrix4_MultiplyVectorAffine", batch, MeasureNsPerOp(batch, [&]() {
+				for (unsigned long i = 0; i < batch; i++) {
+					out[i] = Matrix4_MultiplyVectorAffine(in[i], matView);
+				}
+				sink += out[batch / 2].x;
+			}));
 		}
-		case SDL_SCANCODE_DOWN: {
-			//printf("Tapped SDL_SCANCODE_DOWN\n");
-			MainCamera.fXRotation += offset;
-			break;
+
+		const unsigned long matrixBatch = 1024;
+		std::vector<Matrix4> matrices(matrixBatch), matricesOut(matrixBatch);
+		for (Matrix4 &m : matrices) {
+			Matrix4 rotX = Matrix4_MakeRotationX(random(-3, 3));
+			Matrix4 rotY = Matrix4_MakeRotationY(random(-3, 3));
+			m = Matrix4_MultiplyMatrix(rotX, rotY);
+			m.m[3][0] = random(-10, 10);
+			m.m[3][1] = random(-10, 10);
+			m.m[3][2] = random(-10, 10);
 		}
-		case SDL_SCANCODE_LEFT: {
-			//printf("Tapped SDL_SCANCODE_LEFT\n");
-			MainCamera.fYRotation -= offset;
-			break;
+		report("Matrix4_MultiplyMatrix", matrixBatch, MeasureNsPerOp(matrixBatch, [&]() {
+			for (unsigned long i = 0; i < matrixBatch; i++) {
+				matricesOut[i] = Matrix4_MultiplyMatrix(matrices[i], matView);
+			}
+			sink += matricesOut[matrixBatch / 2].m[3][0];
+		}));
+		report("Matrix4_QuickInverse", matrixBatch, MeasureNsPerOp(matrixBatch, [&]() {
+			for (unsigned long i = 0; i < matrixBatch; i++) {
+				matricesOut[i] = Matrix4_QuickInverse(matrices[i]);
+			}
+			sink += matricesOut[matrixBatch / 2].m[3][0];
+		}));
+
+		const unsigned long segmentBatch = 4096;
+		std::vector<vec3> segmentStart(segmentBatch), segmentEnd(segmentBatch), intersections(segmentBatch);
+		for (unsigned long i = 0; i < segmentBatch; i++) {
+			segmentStart[i] = { random(-5, 5), random(-5, 5), random(0.2f, 10) };
+			segmentEnd[i] = { random(-5, 5), random(-5, 5), random(-10, 0.0f) };
 		}
-		case SDL_SCANCODE_RIGHT: {
-			//printf("Tapped SDL_SCANCODE_RIGHT\n");
-			MainCamera.fYRotation += offset;
-			break;
+		vec3 nearPlanePoint = { 0.0f, 0.0f, 0.1f };
+		vec3 nearPlaneNormal = { 0.0f, 0.0f, 1.0f };
+		report("Vector3_IntersectPlane", segmentBatch, MeasureNsPerOp(segmentBatch, [&]() {
+			for (unsigned long i = 0; i < segmentBatch; i++) {
+				intersections[i] = Vector3_IntersectPlane(nearPlanePoint, nearPlaneNormal, segmentStart[i], segmentEnd[i]);
+			}
+			sink += intersections[segmentBatch / 2].x;
+		}));
+
+		// Mix of triangles fully inside, crossing and fully behind the near plane
+		const unsigned long triangleBatch = 4096;
+		std::vector<Triangle> triangles(triangleBatch);
+		for (Triangle &tri : triangles) {
+			for (vec3 &p : tri.p) {
+				p = { random(-5, 5), random(-5, 5), random(-3, 10) };
+			}
 		}
-		case SDL_SCANCODE_RIGHTBRACKET: {
-			//printf("Tapped SDL_SCANCODE_RIGHTBRACKET\n");
-			if (MainCamera.fFOV > 0 + 1)
-			{
-				MainCamera.fFOV--;
+		report("Triangle_ClipAgainstPlane", triangleBatch, MeasureNsPerOp(triangleBatch, [&]() {
+			Triangle clipped[2];
+			int produced = 0;
+			for (unsigned long i = 0; i < triangleBatch; i++) {
+				produced += Triangle_ClipAgainstPlane(nearPlanePoint, nearPlaneNormal, triangles[i], clipped[0], clipped[1]);
 			}
-			printf("%f\n", MainCamera.fFOV);
-			break;
+			sink += produced;
+		}));
+
+		SDL_Renderer *renderer = CreateHeadlessRenderer(800, 600);
+		if (renderer == NULL) {
+			return 1;
 		}
-		case SDL_SCANCODE_LEFTBRACKET: {
-			//printf("Tapped SDL_SCANCODE_LEFTBRACKET\n");
-			if (MainCamera.fFOV < 180 - 1)
-			{
-				MainCamera.fFOV++;
+		updateScreenAndCameraProperties(renderer);
+		const int polygonSizes[] = { 8, 64, 256 };
+		const char *fillNames[] = { "DrawFilledPolygon2D 8px", "DrawFilledPolygon2D 64px", "DrawFilledPolygon2D 256px" };
+		const char *shadedNames[] = { "DrawFilledPolygon2D shaded 8px", "DrawFilledPolygon2D shaded 64px", "DrawFilledPolygon2D shaded 256px" };
+		const unsigned long rasterBatch = 256;
+		for (int s = 0; s < 3; s++) {
+			int size = polygonSizes[s];
+			// Quads like block sides, uniform ambient occlusion and then a gradient over them
+			std::vector<GE_ScreenPolygon> screenPolygons(rasterBatch);
+			for (GE_ScreenPolygon &polygon : screenPolygons) {
+				float x = random(0, (float)(WIDTH - size - 1));
+				float y = random(0, (float)(HEIGHT - size - 1));
+				polygon.p[0] = { x + random(0, (float)size), y, 0.0f };
+				polygon.p[1] = { x, y + random(0, (float)size), 0.0f };
+				polygon.p[2] = { x + random(0, (float)size), y + size, 0.0f };
+				polygon.p[3] = { x + size, y + random(0, (float)size), 0.0f };
+				std::fill(polygon.ao, polygon.ao + 4, 1.0f);
+				polygon.color = GE_COLORS.getColorByType(Colors::Types::AQUA);
+				polygon.count = 4;
 			}
-			printf("%f\n", MainCamera.fFOV);
-			break;
+			report(fillNames[s], rasterBatch, MeasureNsPerOp(rasterBatch, [&]() {
+				for (GE_ScreenPolygon &polygon : screenPolygons) {
+					DrawFilledPolygon2D(renderer, polygon);
+				}
+			}));
+			for (GE_ScreenPolygon &polygon : screenPolygons) {
+				polygon.ao[0] = AO_LEVELS[0];
+				polygon.ao[1] = AO_LEVELS[2];
+				polygon.ao[2] = AO_LEVELS[3];
+			}
+			report(shadedNames[s], rasterBatch, MeasureNsPerOp(rasterBatch, [&]() {
+				for (GE_ScreenPolygon &polygon : screenPolygons) {
+					DrawFilledPolygon2D(renderer, polygon);
+				}
+			}));
 		}
-		case SDL_SCANCODE_R: {
-			//printf("Tapped SDL_SCANCODE_R\n");
-			resetMainCamera();
-			break;
+
+		// Geometry and raster stages of one frame per style, on a prepared scene
+		const char *styleNames[] = { "Frame shaded", "Frame poly shaded", "Frame polygons only", "Frame shaded span buffer", "Frame shaded grid order" };
+		const RENDERING_STYLES styles[] = { RENDERING_STYLES::STD_SHADED, RENDERING_STYLES::STD_POLY_SHADED, RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS, RENDERING_STYLES::STD_SHADED, RENDERING_STYLES::STD_SHADED };
+		const bool spanBuffer = GE_OPTIONS.spanBuffer;
+		const bool gridOrder = GE_OPTIONS.gridOrder;
+		GE_LOG_EDITS = false;
+		ClearScene();
+		std::vector<vec3> positions = GenerateBenchmarkScene("terrain", 10000);
+		BuildScene(positions);
+		AimCameraAtScene();
+		GE_FrameGeometry &geometry = frameGeometry[0];
+		for (int st = 0; st < 5; st++) {
+			GE_RENDERING_STYLE = styles[st];
+			GE_OPTIONS.spanBuffer = st == 3;
+			GE_OPTIONS.gridOrder = st == 4;
+			PrepareFrameInput(geometry.input);
+			report(styleNames[st], 1, MeasureNsPerOp(1, [&]() {
+				BuildFrameGeometry(geometry);
+				RasterFrameGeometry(renderer, geometry);
+			}));
 		}
-		case SDL_SCANCODE_GRAVE: {
-			//printf("Tapped SDL_SCANCODE_GRAVE\n");
-			GE_CURRENT_KEYBOARD_CONTROL = Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_SCENE_EDITING;
-			break;
+		GE_RENDERING_STYLE = RENDERING_STYLES::STD_SHADED;
+		GE_OPTIONS.spanBuffer = spanBuffer;
+		GE_OPTIONS.gridOrder = gridOrder;
+		ClearScene();
+		SDL_DestroyRenderer(renderer);
+		printf("Checksum: %f\n", sink);
+
+		if (GE_OPTIONS.benchKernelsPath != nullptr) {
+			FILE *f = strcmp(GE_OPTIONS.benchKernelsPath, "-") == 0 ? stdout : fopen(GE_OPTIONS.benchKernelsPath, "w");
+			if (f == NULL) {
+				printf("Unable to write benchmark results to %s\n", GE_OPTIONS.benchKernelsPath);
+				return 1;
+			}
+			fprintf(f, "kernel,batch,ns_per_op\n");
+			for (KernelResult &r : results) {
+				fprintf(f, "%s,%lu,%.3f\n", r.kernel, r.batch, r.nsPerOp);
+			}
+			if (f != stdout) {
+				fclose(f);
+			}
 		}
-		default:
-			printf("Tapped untreated key: %d\n", scancode);
-			break;
+		return 0;
+	}
+
+	unsigned long long HashHeadlessSurface() {
+		unsigned long long hash = 14695981039346656037ull;
+		for (int y = 0; y < headlessSurface->h; y++) {
+			const unsigned char *row = (const unsigned char *)headlessSurface->pixels + y * headlessSurface->pitch;
+			for (int i = 0; i < headlessSurface->w * 4; i++) {
+				hash ^= row[i];
+				hash *= 1099511628211ull;
+			}
 		}
+		return hash;
 	}
 
-	void StartRenderLoop() {
-		SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0); // SDL_RENDERER_ACCELERATED is Default
-		Uint32 start;
-		SDL_Event windowEvent;
-		while (isRunning)
-		{
-			while (SDL_PollEvent(&windowEvent))
-			{
-				if (windowEvent.type == SDL_QUIT)
-				{
-					isRunning = false;
+	int RunGoldenImages() {
+		// Fixed scenes and camera poses, each rendered in every style and compared by pixel hash
+		struct GoldenPose {
+			vec3 position;
+			float fXRotation;
+			float fYRotation;
+		};
+		const GoldenPose poses[] = {
+			{ { 3, 4, 0 }, (float)M_PI / 6.0f, (float)M_PI / 8.0f }, // Same as resetMainCamera
+			{ { -6, 7, -6 }, 0.55f, 0.78f },
+			{ { 1.5f, 1.5f, -0.5f }, 0.1f, -0.3f }, // Inside the scene, exercises near clipping
+		};
+		// Pose 0 is rendered once more with the selector on the block nearest to the camera, it must stay on top in grid order too
+		const int selectorPose = 0;
+		const char *scenes[] = { "solid", "shell", "terrain", "sparse" };
+		const unsigned long sceneBlocks[] = { 64, 200, 100, 150 };
+		const RENDERING_STYLES styles[] = { RENDERING_STYLES::STD_SHADED, RENDERING_STYLES::STD_POLY_SHADED, RENDERING_STYLES::DEBUG_DRAW_ONLY_POLYGONS };
+		// Every case is also rendered through the optional paths of the frame, named by the suffix
+		struct GoldenVariant {
+			const char *suffix;
+			bool pipelined;
+			bool spanBuffer;
+			bool gridOrder;
+			float renderScale;
+		};
+		const GoldenVariant variants[] = {
+			{ "", false, false, false, 1.0f },
+			{ "_pipelined", true, false, false, 1.0f },
+			{ "_spanbuffer", false, true, false, 1.0f },
+			{ "_gridorder", false, false, true, 1.0f },
+			{ "_scale50", false, false, false, 0.5f },
+		};
+		const bool spanBuffer = GE_OPTIONS.spanBuffer;
+		const bool gridOrder = GE_OPTIONS.gridOrder;
+		const float scale = renderScale;
+		const vec3 selectorStart = GE_DRAW_LIST.selectorBox.getPosition();
+		GE_LOG_EDITS = false;
+
+		std::vector<std::pair<std::string, std::string>> expected;
+		if (!GE_OPTIONS.goldenUpdate) {
+			FILE *f = fopen(GE_OPTIONS.goldenPath, "r");
+			if (f == NULL) {
+				printf("Unable to read golden hashes from %s, run with --golden-update first\n", GE_OPTIONS.goldenPath);
+				return 1;
+			}
+			char name[128], hash[32];
+			while (fscanf(f, "%127s %31s", name, hash) == 2) {
+				expected.push_back({ name, hash });
+			}
+			fclose(f);
+		}
+
+		SDL_Renderer *renderer = CreateHeadlessRenderer(320, 240);
+		if (renderer == NULL) {
+			return 1;
+		}
+		std::vector<std::pair<std::string, std::string>> actual;
+		int failures = 0;
+		for (const GoldenVariant &variant : variants) {
+			GE_OPTIONS.spanBuffer = variant.spanBuffer;
+			GE_OPTIONS.gridOrder = variant.gridOrder;
+			renderScale = variant.renderScale;
+			if (variant.pipelined) {
+				StartGeometryThread();
+			}
+			for (int s = 0; s < 4; s++) {
+				ClearScene();
+				std::vector<vec3> positions = GenerateBenchmarkScene(scenes[s], sceneBlocks[s]);
+				vec3 selectorBlock = positions[0];
+				for (const vec3 &pos : positions) {
+					vec3 toPose = Vector3_Sub(pos, poses[selectorPose].position);
+					vec3 toBest = Vector3_Sub(selectorBlock, poses[selectorPose].position);
+					if (Vector3_DotProduct(toPose, toPose) < Vector3_DotProduct(toBest, toBest)) {
+						selectorBlock = pos;
+					}
 				}
+				BuildScene(positions);
+				for (int p = 0; p < 4; p++) {
+					bool onBlock = p == 3;
+					const GoldenPose &pose = poses[onBlock ? selectorPose : p];
+					GE_DRAW_LIST.selectorBox.moveTo(onBlock ? selectorBlock : selectorStart);
+					for (int st = 0; st < 3; st++) {
+						resetMainCamera();
+						MainCamera.position = pose.position;
+						MainCamera.fXRotation = pose.fXRotation;
+						MainCamera.fYRotation = pose.fYRotation;
+						GE_RENDERING_STYLE = styles[st];
+						RenderFrame(renderer);
+						if (geometryInFlight) {
+							RenderFrame(renderer); // Pipelined mode draws the frame submitted by the first call
+						}
 
-				if (windowEvent.type == SDL_KEYDOWN) {
-					switch (GE_CURRENT_KEYBOARD_CONTROL) {
-					case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_SCENE_EDITING:
-						SceneEditingHandle(windowEvent.key.keysym.scancode);
-						break;
-					case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_OBJECT_EDITING:
-						break;
-					case Engine3D::KEYBOARD_CONTROL_TYPES::ALLOW_CAMERA_CONTROL:
-						CameraMovementHandle(windowEvent.key.keysym.scancode);
-						break;
-					default:
-						break;
+						char name[128], hash[32];
+						if (onBlock) {
+							snprintf(name, sizeof(name), "%s_pose%d_style%d_selector%s", scenes[s], selectorPose, st, variant.suffix);
+						} else {
+							snprintf(name, sizeof(name), "%s_pose%d_style%d%s", scenes[s], p, st, variant.suffix);
+						}
+						snprintf(hash, sizeof(hash), "%016llx", HashHeadlessSurface());
+						actual.push_back({ name, hash });
+						if (GE_OPTIONS.goldenUpdate) {
+							continue;
+						}
+
+						bool found = false;
+						for (std::pair<std::string, std::string> &e : expected) {
+							if (e.first == name) {
+								found = true;
+								if (e.second != hash) {
+									std::string imagePath = std::string("golden_") + name + ".bmp";
+									SDL_SaveBMP(headlessSurface, imagePath.c_str());
+									printf("FAIL %s: expected %s, got %s (written %s)\n", name, e.second.c_str(), hash, imagePath.c_str());
+									failures++;
+								}
+							}
+						}
+						if (!found) {
+							printf("FAIL %s: no golden hash\n", name);
+							failures++;
+						}
 					}
 				}
 			}
-			start = SDL_GetTicks();
+			StopGeometryThread();
+		}
+		GE_RENDERING_STYLE = RENDERING_STYLES::STD_SHADED;
+		GE_OPTIONS.spanBuffer = spanBuffer;
+		GE_OPTIONS.gridOrder = gridOrder;
+		renderScale = scale;
+		GE_DRAW_LIST.selectorBox.moveTo(selectorStart);
+		ClearScene();
+		ReleaseSceneTarget();
+		SDL_DestroyRenderer(renderer);
 
-			//Updates properties of the screen and camera
-			updateScreenAndCameraProperties(renderer);
+		if (GE_OPTIONS.goldenUpdate) {
+			FILE *f = fopen(GE_OPTIONS.goldenPath, "w");
+			if (f == NULL) {
+				printf("Unable to write golden hashes to %s\n", GE_OPTIONS.goldenPath);
+				return 1;
+			}
+			for (std::pair<std::string, std::string> &a : actual) {
+				fprintf(f, "%s %s\n", a.first.c_str(), a.second.c_str());
+			}
+			fclose(f);
+			printf("Written %zu golden hashes to %s\n", actual.size(), GE_OPTIONS.goldenPath);
+			return 0;
+		}
+		printf("Golden images: %zu passed, %d failed\n", actual.size() - failures, failures);
+		return failures > 0 ? 1 : 0;
+	}
 
-			//Background(Clears with color)
-			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-			SDL_RenderClear(renderer);
+	int ReplayInput() {
+		FILE *f = fopen(GE_OPTIONS.replayPath, "r");
+		if (f == NULL) {
+			printf("Unable to open replay %s\n", GE_OPTIONS.replayPath);
+			return 1;
+		}
+		int version, width, height;
+		if (fscanf(f, "3DGE_INPUT %d %d %d", &version, &width, &height) != 3 || version != 1) {
+			printf("Invalid replay header in %s\n", GE_OPTIONS.replayPath);
+			fclose(f);
+			return 1;
+		}
 
-			//Draws scene
-			SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-			DrawSceneObjects(renderer);
+		// Events are grouped by the frame they were polled in
+		struct ReplayEvent {
+			unsigned long frame;
+			int scancode;
+		};
+		std::vector<ReplayEvent> events;
+		unsigned long frameCount = 0;
+		char token[32];
+		while (fscanf(f, "%31s", token) == 1) {
+			if (strcmp(token, "end") == 0) {
+				if (fscanf(f, "%lu", &frameCount) != 1) {
+					break;
+				}
+				continue;
+			}
+			ReplayEvent e;
+			e.frame = strtoul(token, NULL, 10);
+			if (fscanf(f, "%d", &e.scancode) != 1) {
+				break;
+			}
+			events.push_back(e);
+			frameCount = std::max(frameCount, e.frame + 1);
+		}
+		fclose(f);
 
-			// Renders window
-			SDL_RenderPresent(renderer);
-			Uint32 ticks = SDL_GetTicks();
-			if (1000 / FRAMES_PER_SECOND > ticks - start) {
-				SDL_Delay(1000 / FRAMES_PER_SECOND - (ticks - start));
+		SDL_Renderer *renderer = CreateHeadlessRenderer(width, height);
+		if (renderer == NULL) {
+			return 1;
+		}
+		FILE *csv = NULL;
+		if (GE_OPTIONS.replayCSVPath != nullptr) {
+			csv = fopen(GE_OPTIONS.replayCSVPath, "w");
+			if (csv != NULL) {
+				fprintf(csv, "frame,events,input_ms,frame_ms,submitted,culled,clipped,drawn,pixels,latency_ms,input_latency_ms\n");
 			}
 		}
-		SDL_DestroyRenderer(renderer);
-	}
 
-	void CreateCubicFormByTopMesh(GE_Object &buffObj, Mesh &Mesh_TOP) {
-		Mesh_Side buffSide;
+		printf("Replaying %zu events over %lu frames (%dx%d)\n", events.size(), frameCount, width, height);
+		if (GE_OPTIONS.pipelined) {
+			StartGeometryThread();
+		}
+		if (GE_OPTIONS.editThread) {
+			StartEditThread(true);
+		}
+		std::vector<double> frameTimes;
+		std::vector<double> inputLatencies, inputApplyTimes;
+		double inputMsTotal = 0;
+		size_t nextEvent = 0;
+		long long replayStart = GE_PROFILER.now();
+		for (frameIndex = 0; frameIndex < frameCount; frameIndex++) {
+			GE_PROFILER.beginFrame();
+			GE_FRAME_STATS = GE_FrameStats();
+			long long frameStart = GE_PROFILER.now();
+
+			int frameEvents = 0;
+			while (nextEvent < events.size() && events[nextEvent].frame == frameIndex) {
+				HandleKeyDown((SDL_Scancode)events[nextEvent].scancode);
+				nextEvent++;
+				frameEvents++;
+			}
+			double inputMs = (GE_PROFILER.now() - frameStart) / 1000000.0;
+			inputMsTotal += inputMs;
 
-		Matrix4 matRotX;
-		Matrix4 matRotY;
-		Matrix4 matRotZ;
-		Matrix4 matRot;
+			if (editThread.joinable()) {
+				SyncEditThread();
+			} else {
+				FlushRegionBuilds();
+			}
+			RenderFrame(renderer);
+			GE_FRAME_STATS.frameMs = (GE_PROFILER.now() - frameStart) / 1000000.0;
+			FinishFrameStats();
+			frameTimes.push_back(GE_FRAME_STATS.frameMs);
+			if (GE_FRAME_STATS.inputLatencyMs > 0) {
+				inputLatencies.push_back(GE_FRAME_STATS.inputLatencyMs);
+				inputApplyTimes.push_back(GE_FRAME_STATS.inputApplyMs);
+			}
 
-		buffSide.type = GE_MESH_SIDE_TYPE::TOP;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(0);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(0);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+			if (csv != NULL) {
+				fprintf(csv, "%lu,%d,%.4f,%.4f,%lu,%lu,%lu,%lu,%llu,%.4f,%.4f\n", frameIndex, frameEvents, inputMs, GE_FRAME_STATS.frameMs,
+					GE_FRAME_STATS.trianglesSubmitted, GE_FRAME_STATS.trianglesCulled, GE_FRAME_STATS.trianglesClipped,
+					GE_FRAME_STATS.trianglesDrawn, GE_FRAME_STATS.pixelsFilled, GE_FRAME_STATS.latencyMs, GE_FRAME_STATS.inputLatencyMs);
 			}
 		}
-		buffObj.sides.push_back(buffSide);
+		double totalMs = (GE_PROFILER.now() - replayStart) / 1000000.0;
+		StopEditThread();
+		StopGeometryThread();
+		ReleaseSceneTarget();
+		SDL_DestroyRenderer(renderer);
+		if (csv != NULL) {
+			fclose(csv);
+		}
+
+		std::vector<double> sortedTimes = frameTimes;
+		std::sort(sortedTimes.begin(), sortedTimes.end());
+		double sum = 0;
+		for (double t : frameTimes) {
+			sum += t;
+		}
+		printf("Replay finished: %lu frames in %.2f ms\n", frameCount, totalMs);
+		if (!sortedTimes.empty()) {
+			printf("Frame ms: avg %.3f, min %.3f, p50 %.3f, p95 %.3f, max %.3f\n", sum / sortedTimes.size(), sortedTimes.front(),
+				sortedTimes[sortedTimes.size() / 2], sortedTimes[sortedTimes.size() * 95 / 100], sortedTimes.back());
+		}
+		printf("Input handling: %.2f ms total\n", inputMsTotal);
+		if (!inputLatencies.empty()) {
+			// Measured per frame showing a new key, from reading it to presenting that frame
+			std::sort(inputLatencies.begin(), inputLatencies.end());
+			std::sort(inputApplyTimes.begin(), inputApplyTimes.end());
+			printf("Input latency ms (%zu frames): p50 %.3f, p95 %.3f, max %.3f, applied p50 %.3f, max %.3f\n", inputLatencies.size(),
+				inputLatencies[inputLatencies.size() / 2], inputLatencies[inputLatencies.size() * 95 / 100], inputLatencies.back(),
+				inputApplyTimes[inputApplyTimes.size() / 2], inputApplyTimes.back());
+		}
+		if (GE_OPTIONS.replayHash) {
+			printf("Scene hash: %016llx\n", HashScene());
+		}
+		if (GE_OPTIONS.profilePrefix != nullptr) {
+			WriteProfile();
+		}
+		if (GE_OPTIONS.exportPath != nullptr && !ExportScene(GE_OPTIONS.exportPath)) {
+			return 1;
+		}
+		return 0;
+	}
 
+	struct GE_EditScriptStats {
+		unsigned long commands = 0;
+		unsigned long edits = 0; // Cell operations, a box counts every cell
+		unsigned long changed = 0; // Edits that changed the scene
+		unsigned long errors = 0;
+	};
 
-		buffSide.type = GE_MESH_SIDE_TYPE::BOTTOM;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(0);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(M_PI);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+	static const unsigned long long MAX_BOX_CELLS = 1ull << 30; // Keeps a box within the 32-bit edit counters
+
+	// Edit script line: command word followed by integers and an optional color name
+	//   coordinates lie in [-2^20, 2^20), the range of a cell key
+	//   move x y z | moveby dx dy dz
+	//   create | remove | color [x y z] [color]       without coordinates acts at the selector
+	//   box create | remove | color x0 y0 z0 x1 y1 z1 [color]
+	//   mesh [x y z] [color]                          places the last imported mesh
+	//   clear
+	bool ApplyEditCommand(const char *line, GE_EditScriptStats &stats) {
+		const char *c = line;
+		char words[2][16] = { "", "" };
+		int wordCount = 0;
+		long numbers[6];
+		int numberCount = 0;
+		int colorType = -1;
+		while (*c != '\0' && *c != '#') {
+			if (isspace((unsigned char)*c)) {
+				c++;
+			} else if (isdigit((unsigned char)*c) || *c == '-' || *c == '+') {
+				char *end;
+				long value = strtol(c, &end, 10);
+				if (end == c || numberCount == 6) {
+					return false;
+				}
+				numbers[numberCount++] = value;
+				c = end;
+			} else {
+				char word[16];
+				int length = 0;
+				while (*c != '\0' && !isspace((unsigned char)*c) && *c != '#') {
+					if (length == (int)sizeof(word) - 1) {
+						return false;
+					}
+					word[length++] = (char)tolower((unsigned char)*c++);
+				}
+				word[length] = '\0';
+				int color = -1;
+				for (int i = 0; i < Colors::COUNT; i++) {
+					if (strcmp(word, GE_COLORS.getColorName((Colors::Types)i)) == 0) {
+						color = i;
+					}
+				}
+				if (color >= 0 && wordCount > 0) {
+					colorType = color;
+				} else if (wordCount < 2) {
+					strcpy(words[wordCount++], word);
+				} else {
+					return false;
+				}
 			}
 		}
-		buffObj.sides.push_back(buffSide);
+		if (wordCount == 0) {
+			return numberCount == 0; // Blank line or comment
+		}
+		stats.commands++;
 
-		buffSide.type = GE_MESH_SIDE_TYPE::WEST;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(0);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(M_PI / 2.0f);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+		bool isBox = strcmp(words[0], "box") == 0;
+		const char *op = isBox ? words[1] : words[0];
+		if (!isBox && wordCount != 1) {
+			return false;
+		}
+		// Every position a command ends up at has to fit in a cell key
+		for (int i = 0; i + 2 < numberCount; i += 3) {
+			if (!IsCellInRange(numbers[i], numbers[i + 1], numbers[i + 2])) {
+				return false;
+			}
+		}
+		vec3 selectorPos = GE_DRAW_LIST.selectorBox.getPosition();
+		if (strcmp(op, "move") == 0 || strcmp(op, "moveby") == 0) {
+			if (isBox || numberCount != 3 || colorType >= 0) {
+				return false;
+			}
+			vec3 v = { (float)numbers[0], (float)numbers[1], (float)numbers[2] };
+			if (strcmp(op, "move") == 0) {
+				GE_DRAW_LIST.selectorBox.moveTo(v);
+				return true;
+			}
+			vec3 target = Vector3_Add(selectorPos, v);
+			if (!IsCellInRange(lroundf(target.x), lroundf(target.y), lroundf(target.z))) {
+				return false;
+			}
+			GE_DRAW_LIST.selectorBox.moveBy(v);
+			return true;
+		}
+		if (strcmp(op, "clear") == 0) {
+			if (isBox || numberCount != 0 || colorType >= 0) {
+				return false;
+			}
+			ClearScene();
+			return true;
+		}
+		if (strcmp(op, "mesh") == 0) {
+			if (isBox || (numberCount != 0 && numberCount != 3)) {
+				return false;
 			}
+			vec3 pos = numberCount == 0 ? selectorPos : vec3{ (float)numbers[0], (float)numbers[1], (float)numbers[2] };
+			stats.edits++;
+			stats.changed += PlaceMeshAt(pos, colorType) ? 1 : 0;
+			return true;
 		}
-		buffObj.sides.push_back(buffSide);
 
-		buffSide.type = GE_MESH_SIDE_TYPE::EAST;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(0);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(-M_PI / 2.0f);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+		int kind = strcmp(op, "create") == 0 ? 0 : strcmp(op, "remove") == 0 ? 1 : strcmp(op, "color") == 0 ? 2 : -1;
+		if (kind < 0 || (colorType >= 0 && kind != 2)) {
+			return false;
+		}
+		auto apply = [&](vec3 pos) {
+			bool changed = false;
+			switch (kind) {
+			case 0: changed = CreateBlockAt(pos); break;
+			case 1: changed = RemoveBlockAt(pos); break;
+			case 2: changed = ChangeBlockColorAt(pos, colorType); break;
+			}
+			stats.edits++;
+			stats.changed += changed ? 1 : 0;
+		};
+		if (!isBox) {
+			if (numberCount == 0) {
+				apply(selectorPos);
+			} else if (numberCount == 3) {
+				apply({ (float)numbers[0], (float)numbers[1], (float)numbers[2] });
+			} else {
+				return false;
+			}
+			return true;
+		}
+		if (numberCount != 6) {
+			return false;
+		}
+		// Cell count has to fit the edit counters, on every platform
+		unsigned long long cells = 1;
+		for (int i = 0; i < 3; i++) {
+			cells *= (unsigned long long)(std::abs(numbers[i + 3] - numbers[i]) + 1);
+		}
+		if (cells > MAX_BOX_CELLS || cells > ULONG_MAX - stats.edits) {
+			return false;
+		}
+		for (long x = std::min(numbers[0], numbers[3]); x <= std::max(numbers[0], numbers[3]); x++) {
+			for (long y = std::min(numbers[1], numbers[4]); y <= std::max(numbers[1], numbers[4]); y++) {
+				for (long z = std::min(numbers[2], numbers[5]); z <= std::max(numbers[2], numbers[5]); z++) {
+					apply({ (float)x, (float)y, (float)z });
+				}
 			}
 		}
-		buffObj.sides.push_back(buffSide);
+		return true;
+	}
 
-		buffSide.type = GE_MESH_SIDE_TYPE::NORTH;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(M_PI / 2.0f);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(0);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+	// Returns false if the script could not be read or had invalid lines
+	bool ApplyEditScriptFile() {
+		bool fromStdin = strcmp(GE_OPTIONS.editScriptPath, "-") == 0;
+		FILE *f = fromStdin ? stdin : fopen(GE_OPTIONS.editScriptPath, "r");
+		if (f == NULL) {
+			printf("Unable to open edit script %s\n", GE_OPTIONS.editScriptPath);
+			return false;
+		}
+		bool logEdits = GE_LOG_EDITS;
+		GE_LOG_EDITS = false;
+
+		// Every finished batch goes to the region workers, so meshes are rebuilt while the next batch is applied
+		GE_EditScriptStats stats;
+		unsigned long lineNumber = 0;
+		unsigned long batchStart = 0;
+		unsigned long batches = 0;
+		char line[512];
+		long long start = GE_PROFILER.now();
+		while (fgets(line, sizeof(line), f) != NULL) {
+			lineNumber++;
+			if (!ApplyEditCommand(line, stats)) {
+				if (stats.errors < 10) {
+					printf("Invalid edit at line %lu: %s", lineNumber, line);
+				}
+				stats.errors++;
 			}
+			if (stats.edits - batchStart >= GE_OPTIONS.editBatch) {
+				GE_ProfileScope scope(GE_PROFILER, "Edit batch");
+				InstallFinishedRegionMeshes();
+				DispatchRegionBuilds();
+				batchStart = stats.edits;
+				batches++;
+			}
+		}
+		if (!fromStdin) {
+			fclose(f);
 		}
-		buffObj.sides.push_back(buffSide);
+		long long applied = GE_PROFILER.now();
+		FlushRegionBuilds();
+		long long finished = GE_PROFILER.now();
+		CompressInactiveRegions(true);
+
+		double applyMs = (applied - start) / 1000000.0;
+		double totalMs = (finished - start) / 1000000.0;
+		printf("Edit script finished: %lu commands, %lu edits (%lu changed), %lu invalid lines, %lu batches\n",
+			stats.commands, stats.edits, stats.changed, stats.errors, batches + 1);
+		printf("Applied in %.2f ms (%.0f edits/s), with region rebuilds %.2f ms (%.0f edits/s)\n",
+			applyMs, applyMs > 0 ? stats.edits / (applyMs / 1000.0) : 0.0, totalMs, totalMs > 0 ? stats.edits / (totalMs / 1000.0) : 0.0);
+		printf("Scene: %zu blocks, %zu regions, hash %016llx\n", SceneBlockCount(), GE_DRAW_LIST.regions.size(), HashScene());
+		printf("Resident: %.1f MB estimated, %.1f MB process\n", ResidentSceneBytes() / (1024.0 * 1024.0), GE_GetResidentMemoryBytes() / (1024.0 * 1024.0));
+		GE_LOG_EDITS = logEdits;
+		return stats.errors == 0;
+	}
 
-		buffSide.type = GE_MESH_SIDE_TYPE::SOUTH;
-		buffSide.mesh = Mesh_TOP;
-		matRotX = Matrix4_MakeRotationX(-M_PI / 2.0f);
-		matRotY = Matrix4_MakeRotationY(0);
-		matRotZ = Matrix4_MakeRotationZ(0);
-		matRot = Matrix4_MakeIdentity();
-		matRot = Matrix4_MultiplyMatrix(matRotX, matRotY); // Transform by rotation by X and Y
-		matRot = Matrix4_MultiplyMatrix(matRot, matRotZ); // Transform by rotation by Y
-		for (Triangle &polygon : buffSide.mesh.polygons) {
-			for (vec3 &v : polygon.p) {
-				v = Matrix4_MultiplyVector(v, matRot);
+	int RunEditScript() {
+		bool applied = ApplyEditScriptFile();
+		if (GE_OPTIONS.profilePrefix != nullptr) {
+			WriteProfile();
+		}
+		if (GE_OPTIONS.exportPath != nullptr && !ExportScene(GE_OPTIONS.exportPath)) {
+			return 1;
+		}
+		return applied ? 0 : 1;
+	}
+
+	void CreateCubicFormByTopMesh(GE_Object &buffObj, std::vector<Triangle> &Mesh_TOP) {
+		// Every side is the top mesh turned by quarter turns, so rotations are exact and built at compile time
+		struct SideRotation {
+			GE_MESH_SIDE_TYPE type;
+			Matrix4 matRot;
+		};
+		static constexpr SideRotation sideRotations[] = {
+			{ GE_MESH_SIDE_TYPE::TOP, Matrix4_MakeIdentity() },
+			{ GE_MESH_SIDE_TYPE::BOTTOM, Matrix4_MakeQuarterRotationZ(2) },
+			{ GE_MESH_SIDE_TYPE::WEST, Matrix4_MakeQuarterRotationZ(1) },
+			{ GE_MESH_SIDE_TYPE::EAST, Matrix4_MakeQuarterRotationZ(-1) },
+			{ GE_MESH_SIDE_TYPE::NORTH, Matrix4_MakeQuarterRotationX(1) },
+			{ GE_MESH_SIDE_TYPE::SOUTH, Matrix4_MakeQuarterRotationX(-1) },
+		};
+
+		for (const SideRotation &rotation : sideRotations) {
+			Mesh_Side buffSide;
+			buffSide.type = rotation.type;
+			buffSide.first = (unsigned short)buffObj.mesh.polygons.size();
+			for (Triangle polygon : Mesh_TOP) {
+				for (vec3 &v : polygon.p) {
+					v = Matrix4_MultiplyVectorAffine(v, rotation.matRot);
+				}
+				buffObj.mesh.addTriangle(polygon);
 			}
+			buffSide.count = (unsigned short)(buffObj.mesh.polygons.size() - buffSide.first);
+			buffObj.sides.push_back(buffSide);
 		}
-		buffObj.sides.push_back(buffSide);
 	}
 
 	void initStdSelector() {
 		GE_Object buffObj;
 		buffObj.setObjType(GE_OBJECT_TYPE::SELECTOR);
 		
-		Mesh Mesh_TOP;
-		Mesh_TOP.polygons = {
+		std::vector<Triangle> Mesh_TOP = {
 			// OUTER PART
 			{  1.0f, 1.2f, 0.0f,   1.0f, 1.2f,  0.2f,   1.2f, 1.2f,  0.2f },
 			{  1.2f, 1.2f, 0.2f,   1.2f, 1.2f, -0.2f,   0.8f, 1.2f, -0.2f },
@@ -1232,7 +5062,7 @@ private:
 			{  1.0f, 0.0f,  0.8f,   1.2f, 0.0f,  1.0f,   1.2f, 0.0f, 0.8f },
 		};
 
-		for (Triangle &polygon : Mesh_TOP.polygons) {
+		for (Triangle &polygon : Mesh_TOP) {
 			for (vec3 &v : polygon.p) {
 				v = Vector3_Add(v, ObjectMeshAnchor);
 			}
@@ -1247,12 +5077,11 @@ private:
 		GE_Object buffObj;
 		buffObj.setObjType(GE_OBJECT_TYPE::CUBE);
 
-		Mesh Mesh_TOP;
-		Mesh_TOP.polygons = {
+		std::vector<Triangle> Mesh_TOP = {
 				{ 0.0f, 1.0f, 0.0f,    0.0f, 1.0f, 1.0f,    1.0f, 1.0f, 1.0f },
 				{ 0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 1.0f,    1.0f, 1.0f, 0.0f },
 		};
-		for (Triangle &polygon : Mesh_TOP.polygons) {
+		for (Triangle &polygon : Mesh_TOP) {
 			for (vec3 &v : polygon.p) {
 				v = Vector3_Add(v, ObjectMeshAnchor);
 			}
@@ -1260,6 +5089,45 @@ private:
 
 		CreateCubicFormByTopMesh(buffObj, Mesh_TOP);
 
+		// Packed blocks store AO per side corner, find the corners and the slot of every triangle corner
+		cubeAOSlots.assign(buffObj.mesh.polygons.size() * 3, 0);
+		for (Mesh_Side &side : buffObj.sides) {
+			int sideIndex = SideIndex(side.type);
+			int corners = 0;
+			for (int n = side.first; n < side.first + side.count; n++) {
+				for (int i = 0; i < 3; i++) {
+					unsigned short v = buffObj.mesh.polygons[n].v[i];
+					int c = 0;
+					while (c < corners && cubeSideCorners[sideIndex][c] != v) {
+						c++;
+					}
+					if (c == corners) {
+						cubeSideCorners[sideIndex][corners++] = v;
+					}
+					cubeAOSlots[3 * n + i] = (unsigned char)(4 * sideIndex + c);
+					cubeSideTriangles[sideIndex][n - side.first][i] = (unsigned char)c;
+				}
+			}
+			// The corner only one triangle has, a corner of the shared diagonal, the other lone corner, the other diagonal corner
+			const unsigned char *first = cubeSideTriangles[sideIndex][0], *second = cubeSideTriangles[sideIndex][1];
+			auto hasCorner = [](const unsigned char *corners, unsigned char c) { return corners[0] == c || corners[1] == c || corners[2] == c; };
+			int diagonal = 0;
+			for (int i = 0; i < 3; i++) {
+				if (!hasCorner(second, first[i])) {
+					cubeSideCycle[sideIndex][0] = first[i];
+				} else {
+					cubeSideCycle[sideIndex][1 + 2 * diagonal++] = first[i];
+				}
+				if (!hasCorner(first, second[i])) {
+					cubeSideCycle[sideIndex][2] = second[i];
+				}
+			}
+
+			const Triangle_Indexed &tri = buffObj.mesh.polygons[side.first];
+			const std::vector<vec3> &vertices = buffObj.mesh.vertices;
+			cubeSideNormals[sideIndex] = Vector3_CrossProduct(Vector3_Sub(vertices[tri.v[1]], vertices[tri.v[0]]), Vector3_Sub(vertices[tri.v[2]], vertices[tri.v[0]]));
+		}
+
 		GE_STD_OBJECTS.CUBE = buffObj;
 	}
 	
@@ -1274,7 +5142,27 @@ private:
 		GE_DRAW_LIST.selectorBox = sBox;
 	}
 
+	ERROR_CODES initSceneData() {
+		if (GE_OPTIONS.importPath != nullptr && !ImportMesh(GE_OPTIONS.importPath)) {
+			return ERROR_CODES::MESH_IMPORT_ERROR;
+		}
+		if (GE_OPTIONS.pageBudgetMB > 0 && !pageStore.open(GE_OPTIONS.pageStorePath)) {
+			printf("Unable to create page store %s\n", GE_OPTIONS.pageStorePath);
+			return ERROR_CODES::PAGE_STORE_ERROR;
+		}
+		return ERROR_CODES::ZERO;
+	}
+
 	ERROR_CODES initEngine() {
+		if (GE_OPTIONS.headless) {
+			if (SDL_Init(0) != 0) {
+				return ERROR_CODES::SDL2_INIT_ERROR;
+			}
+			initStdObjects();
+			initSelectorObject();
+			return initSceneData();
+		}
+
 		if (SDL_Init(SDL_INIT_VIDEO) != 0) {
 			return ERROR_CODES::SDL2_INIT_ERROR;
 		}
@@ -1299,11 +5187,23 @@ private:
 		initSelectorObject();
 		printf("Initialized selector object!\n");
 
-		return ERROR_CODES::ZERO;
+		return initSceneData();
 	}
 
 	void Destroy() {
-		SDL_DestroyWindow(window);
+		StopGeometryThread();
+		pagingPool.waitIdle();
+		if (pageStore.isOpen()) {
+			printf("Paging: %lu regions paged out, %lu paged in, resident peak %.1f MB of %.1f MB budget, %.1f MB on disk\n",
+				regionsPagedOut, regionsPagedIn, residentBytesPeak / (1024.0 * 1024.0), GE_OPTIONS.pageBudgetMB, pageStore.bytesOnDisk() / (1024.0 * 1024.0));
+			pageStore.close();
+		}
+		if (headlessSurface != NULL) {
+			SDL_FreeSurface(headlessSurface);
+		}
+		if (window != NULL) {
+			SDL_DestroyWindow(window);
+		}
 		SDL_Quit();
 		printf("Destroyed 3DGE!\n");
 	}
@@ -1314,6 +5214,18 @@ public:
 		HEIGHT = _HEIGHT;
 		GE_ERROR_CODE = initEngine();
 	}
+	Engine3D(int _WIDTH, int _HEIGHT, GE_LaunchOptions _options) {
+		WIDTH = _WIDTH;
+		HEIGHT = _HEIGHT;
+		GE_OPTIONS = _options;
+		showProfilerOverlay = GE_OPTIONS.showProfilerOverlay;
+		GE_OPTIONS.renderScaleMin = std::min(1.0f, std::max(0.1f, GE_OPTIONS.renderScaleMin));
+		GE_OPTIONS.renderScaleMax = std::min(1.0f, std::max(GE_OPTIONS.renderScaleMin, GE_OPTIONS.renderScaleMax));
+		if (GE_OPTIONS.renderScale > 0) {
+			renderScale = std::min(1.0f, std::max(0.1f, GE_OPTIONS.renderScale));
+		}
+		GE_ERROR_CODE = initEngine();
+	}
 	Engine3D() {
 		WIDTH = 800;
 		HEIGHT = 600;
@@ -1326,7 +5238,7 @@ public:
 
 	void startScene() {
 		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
-			printf("Unable to start scene! ERROR: %d\n", GE_ERROR_CODE);
+			printf("Unable to start scene! ERROR: %d\n", (int)GE_ERROR_CODE);
 			return;
 		}
 		resetMainCamera();
@@ -1334,6 +5246,51 @@ public:
 		isRunning = true;
 		StartRenderLoop();
 	}
+
+	int benchmarkScenes() {
+		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
+			printf("Unable to start benchmarks! ERROR: %d\n", (int)GE_ERROR_CODE);
+			return 1;
+		}
+		return RunSceneBenchmarks();
+	}
+
+	int benchmarkKernels() {
+		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
+			printf("Unable to start benchmarks! ERROR: %d\n", (int)GE_ERROR_CODE);
+			return 1;
+		}
+		return RunKernelBenchmarks();
+	}
+
+	int checkGoldenImages() {
+		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
+			printf("Unable to start golden images! ERROR: %d\n", (int)GE_ERROR_CODE);
+			return 1;
+		}
+		return RunGoldenImages();
+	}
+
+	int applyEditScript() {
+		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
+			printf("Unable to start edit script! ERROR: %d\n", (int)GE_ERROR_CODE);
+			return 1;
+		}
+		return RunEditScript();
+	}
+
+	int replayInput() {
+		if (GE_ERROR_CODE != ERROR_CODES::ZERO) {
+			printf("Unable to start replay! ERROR: %d\n", (int)GE_ERROR_CODE);
+			return 1;
+		}
+		resetMainCamera();
+		// Edit script builds the scene the replay starts from
+		if (GE_OPTIONS.editScriptPath != nullptr && !ApplyEditScriptFile()) {
+			return 1;
+		}
+		return ReplayInput();
+	}
 };
 
 
@@ -1341,8 +5298,103 @@ public:
 
 
 
+bool Engine3D::GE_LOG_EDITS = true;
+
 int main(int argc, char *argv[]) {
-	Engine3D Engine(800, 600);
+	GE_LaunchOptions options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			options.profilePrefix = argv[++i];
+		} else if (strcmp(argv[i], "--overlay") == 0) {
+			options.showProfilerOverlay = true;
+		} else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+			options.renderScale = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--render-scale-min") == 0 && i + 1 < argc) {
+			options.renderScaleMin = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--render-scale-max") == 0 && i + 1 < argc) {
+			options.renderScaleMax = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) {
+			options.frameBudgetMs = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--pipelined") == 0) {
+			options.pipelined = true;
+		} else if (strcmp(argv[i], "--span-buffer") == 0) {
+			options.spanBuffer = true;
+		} else if (strcmp(argv[i], "--grid-order") == 0) {
+			options.gridOrder = true;
+		} else if (strcmp(argv[i], "--edit-thread") == 0) {
+			options.editThread = true;
+		} else if (strcmp(argv[i], "--page-budget") == 0 && i + 1 < argc) {
+			options.pageBudgetMB = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--page-radius") == 0 && i + 1 < argc) {
+			options.pageRadius = std::max(0, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--page-store") == 0 && i + 1 < argc) {
+			options.pageStorePath = argv[++i];
+		} else if (strcmp(argv[i], "--compress-after") == 0 && i + 1 < argc) {
+			options.compressAfterFrames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			options.recordPath = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			options.replayPath = argv[++i];
+			options.headless = true;
+		} else if (strcmp(argv[i], "--replay-csv") == 0 && i + 1 < argc) {
+			options.replayCSVPath = argv[++i];
+		} else if (strcmp(argv[i], "--replay-hash") == 0) {
+			options.replayHash = true;
+		} else if (strcmp(argv[i], "--bench-scenes") == 0) {
+			options.benchScenes = true;
+			options.headless = true;
+			if (i + 1 < argc && (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0)) { // "-" is stdout
+				options.benchScenesPath = argv[++i];
+			}
+		} else if (strcmp(argv[i], "--bench-baseline") == 0 && i + 1 < argc) {
+			options.benchBaselinePath = argv[++i];
+		} else if (strcmp(argv[i], "--bench-threshold") == 0 && i + 1 < argc) {
+			options.benchThreshold = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--bench-max-blocks") == 0 && i + 1 < argc) {
+			options.benchMaxBlocks = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+			options.benchFrames = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--bench-kernels") == 0) {
+			options.benchKernels = true;
+			options.headless = true;
+			if (i + 1 < argc && (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0)) { // "-" is stdout
+				options.benchKernelsPath = argv[++i];
+			}
+		} else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+			options.goldenPath = argv[++i];
+			options.headless = true;
+		} else if (strcmp(argv[i], "--edit-script") == 0 && i + 1 < argc) {
+			options.editScriptPath = argv[++i];
+			options.headless = true;
+		} else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+			options.importPath = argv[++i];
+		} else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+			options.exportPath = argv[++i];
+		} else if (strcmp(argv[i], "--edit-batch") == 0 && i + 1 < argc) {
+			options.editBatch = std::max(1ul, strtoul(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--golden-update") == 0) {
+			options.goldenUpdate = true;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+		}
+	}
+
+	Engine3D Engine(800, 600, options);
+	if (options.replayPath != nullptr) {
+		return Engine.replayInput();
+	}
+	if (options.benchScenes) {
+		return Engine.benchmarkScenes();
+	}
+	if (options.benchKernels) {
+		return Engine.benchmarkKernels();
+	}
+	if (options.goldenPath != nullptr) {
+		return Engine.checkGoldenImages();
+	}
+	if (options.editScriptPath != nullptr) {
+		return Engine.applyEditScript();
+	}
 	Engine.startScene();
     return 0;
 }